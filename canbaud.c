@@ -0,0 +1,24 @@
+#include <stdint.h>
+
+#include "canbaud.h"
+
+// ECAN registers of the PIC24/dsPIC33 parts, other CAN modules lay bit timing
+// out differently
+#if getenv("SFR_VALID:C1CFG1")
+#word CAN_BT_C1CFG1 = getenv("SFR:C1CFG1")
+#word CAN_BT_C1CFG2 = getenv("SFR:C1CFG2")
+#word CAN_BT_C1CTRL1 = getenv("SFR:C1CTRL1")   // OPMODE<7:5>, as CAN_OP_MODE
+#else
+#error canbaud.c needs the ECAN C1CFG1/C1CFG2 registers (PIC24/dsPIC33)
+#endif
+
+void can_bt_apply()
+{
+   CAN_OP_MODE mode = (CAN_OP_MODE)((CAN_BT_C1CTRL1 >> 5) & 7);
+
+   // Update=FALSE both ways, the driver's saved mode stays what can_init() set
+   can_set_mode(CAN_OP_CONFIG, FALSE);
+   CAN_BT_C1CFG1 = CAN_BT_CFG1;
+   CAN_BT_C1CFG2 = CAN_BT_CFG2;
+   can_set_mode(mode, FALSE);
+}
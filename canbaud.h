@@ -0,0 +1,145 @@
+#ifndef _CANBAUD_H_
+#define _CANBAUD_H_
+
+// ECAN bit timing worked out by the preprocessor for CAN_BAUD_RATE. The build
+// stops with an error when the rate cannot be reached exactly from the CAN
+// clock, instead of running mistimed. can_init() is CCS library code and still
+// runs its own can_set_baud() search; can_bt_apply() then replaces whatever
+// that found with the checked values, so it adds to the start-up rather than
+// saving code or time.
+//
+// One bit is TQ time quanta: 1 sync + PRSEG + SEG1PH before the sample point,
+// SEG2PH after it, each segment 1..8. TQ = 2 * BRP / Fcan, BRP 1..64. The
+// largest TQ count that divides the clock evenly and puts the sample point
+// within CAN_BT_SP_TOLERANCE of CAN_DEFAULT_SAMPLE_POINT (both per mille) wins.
+// tools/canbaud_table.c prints the solution for every common clock and rate.
+
+#ifndef CAN_BAUD_RATE
+#define CAN_BAUD_RATE               125000
+#endif
+
+#ifndef CAN_DEFAULT_SAMPLE_POINT
+#define CAN_DEFAULT_SAMPLE_POINT    875
+#endif
+
+#ifndef CAN_CLOCK_DIVISOR
+#define CAN_CLOCK_DIVISOR           2
+#endif
+
+#ifndef CAN_BRG_SAM
+#define CAN_BRG_SAM                 0
+#endif
+
+#ifndef CAN_BRG_WAKE_FILTER
+#define CAN_BRG_WAKE_FILTER         0
+#endif
+
+#ifndef CAN_BT_SP_TOLERANCE
+#define CAN_BT_SP_TOLERANCE         25
+#endif
+
+#ifndef CAN_BT_SJW
+#define CAN_BT_SJW                  1     // resync jump width, 1..4 TQ
+#endif
+
+/**
+ * Description:
+ *   Clock presented to the ECAN peripheral, in Hz.
+ */
+#ifndef CAN_BT_CLOCK
+#define CAN_BT_CLOCK                (getenv("CLOCK") / CAN_CLOCK_DIVISOR)
+#endif
+
+/** --- Solver, usable in #if and at run time -------------------------------- */
+#define __CAN_BT_MIN(a, b)          ((a) < (b) ? (a) : (b))
+#define __CAN_BT_MAX(a, b)          ((a) > (b) ? (a) : (b))
+
+// SEG2PH for the nearest sample point, within 2..8 and leaving PRSEG + SEG1PH
+// no more than 16
+#define __CAN_BT_SEG2(n, sp)                                             \
+   __CAN_BT_MIN(8, __CAN_BT_MAX(__CAN_BT_MAX(2, (n) - 17),               \
+                                (n) - ((n) * (sp) + 500) / 1000))
+#define __CAN_BT_REST(n, sp)        ((n) - 1 - __CAN_BT_SEG2(n, sp))  // PRSEG + SEG1PH
+#define __CAN_BT_SP(n, sp)          (((n) - __CAN_BT_SEG2(n, sp)) * 1000 / (n))
+#define __CAN_BT_BRP(clk, rate, n)  ((clk) / (2UL * (n) * (rate)))
+
+#define __CAN_BT_OK(clk, rate, sp, n)                                    \
+   ((clk) % (2UL * (n) * (rate)) == 0 &&                                 \
+    __CAN_BT_BRP(clk, rate, n) >= 1 && __CAN_BT_BRP(clk, rate, n) <= 64 && \
+    __CAN_BT_SEG2(n, sp) >= CAN_BT_SJW &&                               \
+    __CAN_BT_REST(n, sp) >= __CAN_BT_SEG2(n, sp) &&                     \
+    __CAN_BT_SP(n, sp) >= (sp) - CAN_BT_SP_TOLERANCE &&                 \
+    __CAN_BT_SP(n, sp) <= (sp) + CAN_BT_SP_TOLERANCE)
+
+#define __CAN_BT_SEG1(n, sp)        ((__CAN_BT_REST(n, sp) + 1) / 2)
+#define __CAN_BT_PRSEG(n, sp)       (__CAN_BT_REST(n, sp) - __CAN_BT_SEG1(n, sp))
+
+// C1CFG1 / C1CFG2 images, every field is stored minus one
+#define __CAN_BT_CFG1(clk, rate, n) \
+   (((CAN_BT_SJW - 1) << 6) | (__CAN_BT_BRP(clk, rate, n) - 1))
+#define __CAN_BT_CFG2(n, sp)                                             \
+   ((CAN_BRG_WAKE_FILTER << 14) | ((__CAN_BT_SEG2(n, sp) - 1) << 8) |    \
+    0x80 | (CAN_BRG_SAM << 6) | ((__CAN_BT_SEG1(n, sp) - 1) << 3) |      \
+    (__CAN_BT_PRSEG(n, sp) - 1))
+/* -------------------------------------------------------------------------- */
+
+#ifndef CAN_BT_NO_CHECK
+
+#define __CAN_BT_FITS(n) \
+   __CAN_BT_OK(CAN_BT_CLOCK, CAN_BAUD_RATE, CAN_DEFAULT_SAMPLE_POINT, n)
+
+#if __CAN_BT_FITS(25)
+#define CAN_BT_TQ       25
+#elif __CAN_BT_FITS(24)
+#define CAN_BT_TQ       24
+#elif __CAN_BT_FITS(23)
+#define CAN_BT_TQ       23
+#elif __CAN_BT_FITS(22)
+#define CAN_BT_TQ       22
+#elif __CAN_BT_FITS(21)
+#define CAN_BT_TQ       21
+#elif __CAN_BT_FITS(20)
+#define CAN_BT_TQ       20
+#elif __CAN_BT_FITS(19)
+#define CAN_BT_TQ       19
+#elif __CAN_BT_FITS(18)
+#define CAN_BT_TQ       18
+#elif __CAN_BT_FITS(17)
+#define CAN_BT_TQ       17
+#elif __CAN_BT_FITS(16)
+#define CAN_BT_TQ       16
+#elif __CAN_BT_FITS(15)
+#define CAN_BT_TQ       15
+#elif __CAN_BT_FITS(14)
+#define CAN_BT_TQ       14
+#elif __CAN_BT_FITS(13)
+#define CAN_BT_TQ       13
+#elif __CAN_BT_FITS(12)
+#define CAN_BT_TQ       12
+#elif __CAN_BT_FITS(11)
+#define CAN_BT_TQ       11
+#elif __CAN_BT_FITS(10)
+#define CAN_BT_TQ       10
+#elif __CAN_BT_FITS(9)
+#define CAN_BT_TQ       9
+#elif __CAN_BT_FITS(8)
+#define CAN_BT_TQ       8
+#else
+#error CAN_BAUD_RATE cannot be reached from the CAN clock with this sample point, see tools/canbaud_table.c
+#endif
+
+#define CAN_BT_BRP      __CAN_BT_BRP(CAN_BT_CLOCK, CAN_BAUD_RATE, CAN_BT_TQ)
+#define CAN_BT_CFG1     __CAN_BT_CFG1(CAN_BT_CLOCK, CAN_BAUD_RATE, CAN_BT_TQ)
+#define CAN_BT_CFG2     __CAN_BT_CFG2(CAN_BT_TQ, CAN_DEFAULT_SAMPLE_POINT)
+
+/**
+ * Description:
+ *   Loads the bit timing above into the ECAN configuration registers. Call
+ *   after can_init(), it goes through configuration mode and back to the
+ *   mode the controller was in.
+ */
+void can_bt_apply();
+
+#endif /* CAN_BT_NO_CHECK */
+
+#endif /* _CANBAUD_H_ */
@@ -1,56 +1,167 @@
 #include "canbus.h"
+#include "canhw.h"    // PIC ECAN driver or SocketCAN
 
+#define CIRCBUF_STATS_CLOCK()  (*STBoard.milliseconds)  // time at full in ms
 #include "circbuf.h"  // this stays here, don't move me, preprocessors work hard
 #include "circbuf.c"  // this stays here, don't move me, preprocessors work hard
-
-//#include "util.h"  // revist safe array copying.
-
-// CCS C requires different headers for send and receive
-// Hence the need for 2 frame types
-typedef struct
-{
-   CAN_RX_HEADER header;   // see the CAN oject definition in can-pic18_fd.h
-                           //   length of data is in his header object
-                           //   and is size uint8_t -- 1 byte
-   uint8_t data[8];        // data storage for message
-   can_ec_t errors;        // error codes for message
-   uint32_t counter;        // tracking num. via STBoard.can_msg_rx counter.
-} can_rx_frame_t;
-
+#include "pool.h"
+#include "pool.c"
+#include "latency.h"
+#include "latency.c"
+#ifdef CAN_BACKEND_SOCKETCAN
+#include "socketcan.c"  // needs lat_now
+#endif
+#include "canlog.h"
+#include "canlog.c"
+
+
+#include "canframe.h"  // can_rx_frame_t, can_tx_frame_t, can_frame_t
+
+// Frames shared by every ring below: one per ring slot, so a full ring and
+// never an empty pool is what drops a frame, and a few for the frames main
+// holds between a pop and the free
+#ifndef CAN_FRAME_POOL_SIZE
+#if USE_CAN2_PERIPHERAL == TRUE
+#define CAN_FRAME_POOL_SIZE   (4 * 32 + 4)
+#else
+#define CAN_FRAME_POOL_SIZE   (2 * 32 + 4)
+#endif
+#endif
+
+#ifndef CAN_TX_PRIORITY
+#define CAN_TX_PRIORITY       0     // can_pack() / can_pack_id() frames, 0-3
+#endif
+
+// Frames live in the pool, the rings only carry handles to them
+POOL_DEF(can_frame_t, can_frame_pool, CAN_FRAME_POOL_SIZE);
+CIRCBUF_DEF(pool_handle_t, rx_ring_buf, 32 );  // circular buffer 32 in size
+CIRCBUF_DEF(pool_handle_t, tx_ring_buf, 32 );  // circular buffer 32 in size
+
+// Start-up timing, see can_setup_early()
 typedef struct
 {
-   CAN_TX_HEADER header;    // see the CAN oject definition in can-pic18_fd.h
-                            //   length of the data is in this header object
-   uint8_t data[8];         // data storage message
-   can_ec_t errors;        // error codes for message
-   uint32_t counter;        // tracking num. via STBoard.can_msg_rx counter.
-} can_tx_frame_t;
-
-CIRCBUF_DEF(can_rx_frame_t, rx_ring_buf, 32 );  // circular buffer 32 in size
-CIRCBUF_DEF(can_tx_frame_t, tx_ring_buf, 32 );  // circular buffer 32 in size
+   uint32_t start;            // lat_now() right after lat_init()
+   uint32_t rx_on;            // lat_now() when the receiver was enabled
+   uint32_t first_rx;         // lat_now() stamp of the first frame
+   uint32_t ready;            // lat_now() when can_setup_late() returned
+   uint16_t early_frames;     // frames received before then
+   int1 got_rx;
+   int1 done;
+} can_boot_t;
+
+can_boot_t can_boot;
+
+#ifdef CAN_LOG_BINARY
+// The binary log gets a UART of its own: a text line in between would read as
+// records and desync the decoder. The application sets it up, e.g.
+//   #use rs232(baud=115200,xmit=PIN_B0,bits=8,stream=CAN_LOG_U2,UART2)
+#ifndef CAN_LOG_STREAM
+#define CAN_LOG_STREAM  CAN_LOG_U2
+#endif
+canlog_t can_log;  // can_setup_late() starts it, can_log_frame() fills it
+#endif
+
+#ifdef CAN_RX_BCAST_READERS
+// Every received frame, once, for CAN_RX_BCAST_READERS independent readers
+// (logger, signal decoder, ...). Slow readers are lapped, never the ISR.
+#ifndef CAN_RX_BCAST_SIZE
+#define CAN_RX_BCAST_SIZE     16
+#endif
+CIRCBUF_BCAST_DEF(can_rx_frame_t, rx_bcast_buf, CAN_RX_BCAST_SIZE, CAN_RX_BCAST_READERS, 1);
+#endif
+
+#include "flightrec.h"  // needs can_rx_frame_t
+#include "flightrec.c"
+#define DIE_HOOK(err)   fr_event(FR_EVT_DIE, (uint8_t)(err)[0])
+#ifndef CAN_BACKEND_SOCKETCAN
+#ifdef UTIL_H
+#error canbus.c must be included before util.h for the die() hook
+#endif
+#include "util.h"       // revist safe array copying. After DIE_HOOK, die() uses it
+#endif
+#ifdef LOW_POWER_IDLE
+#ifndef LP_BUSY
+#define LP_BUSY()       (CIRCBUF_FS(rx_ring_buf) != rx_ring_buf.size)  // drain first
+#endif
+#include "lowpower.h"   // needs lat_now and rx_ring_buf
+#include "lowpower.c"
+#endif
+#include "canerr.h"
+#include "canerr.c"
+#ifdef CAN_RX_FILTER
+#include "isotp.h"
+#ifndef RXF_NO_DEDUP
+// consecutive frames of a transfer may repeat byte for byte
+#define RXF_NO_DEDUP(id, ext)   (((id) & ISOTP_RX_ID_MASK) == ISOTP_RX_ID)
+#endif
+#include "rxfilter.h"   // needs can_rx_frame_t
+#include "rxfilter.c"
+#endif
 
 // This interrupt is triggered when a message is received to CAN
+#ifndef CAN_BACKEND_SOCKETCAN
 #INT_C1RX
+#endif
 void can_rx_isr()
 {
-   if ( !can_kbhit() ) { return; } // bail out, something grabbed our bytes before we could get to it.
+   if ( !CAN_HW_KBHIT() ) { return; } // bail out, something grabbed our bytes before we could get to it.
    
    STBoard.can_msg_rx++;
    
-   can_rx_frame_t temp_my_can_msg;
-   uint8_t *pdata = &temp_my_can_msg.data;
-   temp_my_can_msg.counter = STBoard.can_msg_rx;
+   pool_handle_t h;
+   can_rx_frame_t drop_frame;
+   can_rx_frame_t *my_can_msg = &drop_frame;
+
+   h = POOL_ALLOC_ISR(can_frame_pool);
+   if ( h != POOL_NONE )
+      my_can_msg = &POOL_PTR(can_frame_pool, h)->rx;
+
+   uint8_t *pdata = my_can_msg->data;
+   my_can_msg->timestamp = CAN_HW_RX_STAMP();
+   my_can_msg->counter = STBoard.can_msg_rx;
+   if ( !can_boot.got_rx )
+   {
+      can_boot.first_rx = my_can_msg->timestamp;
+      can_boot.got_rx = TRUE;
+   }
+   if ( !can_boot.done )
+      can_boot.early_frames++;  // buffered while can_setup_late() runs
    
    can_ec_t ret;
-   ret = can_getd(&temp_my_can_msg.header, pdata, CAN_OBJECT_FIFO_1);
-   temp_my_can_msg.errors = ret;
+   // read straight into the pooled frame, no copy on the way to the ring
+   ret = CAN_HW_GETD(&my_can_msg->header, pdata);
+   my_can_msg->errors = ret;
+   fr_frame(my_can_msg);  // one push, cheap enough to leave on
+#ifdef CAN_RX_FILTER
+   // repeats and rate limited Ids stop here, before they cost a ring slot
+   if ( !rxf_pass(my_can_msg, *STBoard.milliseconds) )
+   {
+      if ( h != POOL_NONE )
+         POOL_FREE_ISR(can_frame_pool, h);
+      return;
+   }
+#endif
+#ifdef CAN_RX_BCAST_READERS
+   rx_bcast_buf_push_refd(my_can_msg);
+#endif
   
    /* WARNING- Compiler / Debugger Quirk 
     * The size of the stored data in data[i] is 2 bytes
     * the debugger only shows 1 byte
     */
-   if (rx_ring_buf_push_refd(&temp_my_can_msg))
+   if ( h == POOL_NONE )
    {
+      fprintf(RS232_U1,
+         "[%8Ld]:CAN:"
+         "ERROR: Out of frames in pool!"
+         "\n\r",
+         *STBoard.milliseconds
+      );
+      return;  // frame was read into drop_frame to clear the FIFO
+   }
+   if (rx_ring_buf_push_refd(&h))
+   {
+      POOL_FREE_ISR(can_frame_pool, h);
       fprintf(RS232_U1,
          "[%8Ld]:CAN:"
          "ERROR: Out of space in RX Ring Buffer!"
@@ -63,17 +174,162 @@ void can_rx_isr()
 }
 
 
+#ifdef CAN_BACKEND_SOCKETCAN
+// Stands in for the RX interrupt on the host: waits up to `timeout_ms` for a
+// batch of frames and runs can_rx_isr() once per frame.
+int16_t can_rx_poll ( int timeout_ms )
+{
+   int16_t n = sc_rx_batch(timeout_ms);
+
+   while ( CAN_HW_KBHIT() )
+      can_rx_isr();
+   return n;
+}
+#endif
+
+// Takes the oldest received frame off the RX ring. The caller owns the
+// handle and must either POOL_FREE it or pass it on with can_forward().
+pool_handle_t can_rx_take()
+{
+   pool_handle_t h;
+
+   if (rx_ring_buf_pop_refd(&h))
+      return POOL_NONE;  // Empty
+   lat_record(POOL_PTR(can_frame_pool, h)->rx.timestamp);  // time spent queued
+   return h;
+}
+
+#ifdef CAN_RX_BCAST_READERS
+// Copies the next received frame for broadcast reader `reader` into `frame`.
+// Returns 0 on success, 1 when frames were missed before this one, -1 when
+// this reader has seen everything.
+int16_t can_rx_bcast_read ( uint8_t reader, can_rx_frame_t *frame )
+{
+   return CIRCBUF_BCAST_POP(rx_bcast_buf, reader, frame);
+}
+#endif
+
+// Turns the RX view of pooled frame `frame` into a TX frame with Id `id`. Only
+// the header is rewritten, the payload stays where the ISR put it.
+static void can_frame_to_tx ( can_frame_t *frame, uint32_t id )
+{
+   CAN_RX_HEADER rx_header;
+
+   rx_header = frame->rx.header;  // the two headers overlap, save it first
+   frame->tx.header.Id = id;
+   frame->tx.header.Length = rx_header.Length;
+   frame->tx.header.ext = rx_header.ext;
+   frame->tx.header.rtr = rx_header.rtr;
+   frame->tx.header.Priority = 0;
+   frame->tx.counter = CAN_TX_FORWARDED;  // can_tx() doesn't print these
+}
+
+// Queues received frame `h` for transmission with Id `id`. The handle is
+// consumed whether or not this succeeds.
+int16_t can_forward ( pool_handle_t h, uint32_t id )
+{
+   can_frame_to_tx(POOL_PTR(can_frame_pool, h), id);
+
+   if ( tx_ring_buf_push_refd(&h) )
+   {
+      POOL_FREE(can_frame_pool, h);
+      fprintf(RS232_U1,"[%8Ld]:CAN:"
+           "TX Buffer is Full\n\r",
+           *STBoard.milliseconds
+        );
+      return -1;
+   }
+   return 0;
+}
+
+#if USE_CAN2_PERIPHERAL == TRUE
+// CAN2 shares the frame pool with CAN1, so a frame received on one bus is
+// sent on the other by moving its handle between rings.
+CIRCBUF_DEF(pool_handle_t, rx2_ring_buf, 32 );
+CIRCBUF_DEF(pool_handle_t, tx2_ring_buf, 32 );
+
+#INT_C2RX
+void can2_rx_isr()
+{
+   if ( !can2_kbhit() ) { return; }
+
+   pool_handle_t h;
+   can_rx_frame_t drop_frame;
+   can_rx_frame_t *my_can_msg = &drop_frame;
+
+   h = POOL_ALLOC_ISR(can_frame_pool);
+   if ( h != POOL_NONE )
+      my_can_msg = &POOL_PTR(can_frame_pool, h)->rx;
+
+   my_can_msg->timestamp = lat_now();
+   my_can_msg->counter = 0;
+   my_can_msg->errors = can2_getd(&my_can_msg->header, my_can_msg->data);
+
+   if ( h == POOL_NONE )
+      return;  // no printing here, the gateway runs at full bus load
+   if ( rx2_ring_buf_push_refd(&h) )
+      POOL_FREE_ISR(can_frame_pool, h);
+}
+
+// Same as can_rx_take() for frames received on CAN2
+pool_handle_t can2_rx_take()
+{
+   pool_handle_t h;
+
+   if (rx2_ring_buf_pop_refd(&h))
+      return POOL_NONE;  // Empty
+   return h;
+}
+
+// Same as can_forward() but queues the frame on CAN2, without logging so it
+// can be used at full bus load.
+int16_t can2_forward ( pool_handle_t h, uint32_t id )
+{
+   can_frame_to_tx(POOL_PTR(can_frame_pool, h), id);
+
+   if ( tx2_ring_buf_push_refd(&h) )
+   {
+      POOL_FREE(can_frame_pool, h);
+      return -1;
+   }
+   return 0;
+}
+
+// Loads as many queued CAN2 frames as the peripheral has TX buffers for.
+// Frames stay queued while the bus is busy, nothing is lost.
+int16_t can2_tx()
+{
+   pool_handle_t h;
+   can_tx_frame_t *frame;
+
+   while ( can2_tbe() && CIRCBUF_PEEK(tx2_ring_buf, &h) == 0 )
+   {
+      frame = &POOL_PTR(can_frame_pool, h)->tx;
+      if ( can2_putd(&frame->header, frame->data) != CAN_EC_OK )
+         return -1;
+      CIRCBUF_POP(tx2_ring_buf, NULL);
+      POOL_FREE(can_frame_pool, h);
+   }
+   return 0;
+}
+#endif
+
 void can_handle_err ( can_ec_t err )
 {
+     can_err_stats.frame_errors++;
+     if ( *STBoard.milliseconds - can_err_log_ms < CAN_ERR_LOG_MS )
+        return;  // counted, a faulty bus shouldn't flood the UART
+
      // Disable printf statement to not run during an ISR,
      // compiler correctly warns when enabling this.
      fprintf(RS232_U1,
        "[%8Ld]:CAN:"
-       "Received message level ERROR [%d]:"
+       "Received message level ERROR [%d] (%Lu total):"
        "\r\n",
        *STBoard.milliseconds,
-       err
+       err, can_err_stats.frame_errors
      );
+     can_err_log_ms = *STBoard.milliseconds;
 }
 
 
@@ -115,46 +371,169 @@ static inline char hex_nibble (uint8_t bin)
 //!         tmp[3] << 24 ;
 //!}
 
-int16_t can_pack ( uint8_t mydata[], uint8_t size )
+// Queues `size` bytes of `mydata` for transmission with Id `id` and TX
+// priority `priority` (0-3, 3 goes first). While error passive can_tx() holds
+// back frames below CAN_ERR_MIN_PRIORITY, see canerr.h.
+int16_t can_pack_id_prio ( uint32_t id, uint8_t mydata[], uint8_t size,
+                           uint8_t priority )
 {
 
-   can_tx_frame_t out_frame;
+   pool_handle_t h;
+   can_tx_frame_t *out_frame;
+
+   if ( size > 8 )  // classic CAN, longer payloads go through isotp_send()
+   {
+      fprintf(RS232_U1,"[%8Ld]:CAN:"
+           "TX Payload too long [%u]\n\r",
+           *STBoard.milliseconds, size
+        );
+      return -1;
+   }
+
+   h = POOL_ALLOC(can_frame_pool);
+   if ( h == POOL_NONE )
+   {
+      fprintf(RS232_U1,"[%8Ld]:CAN:"
+           "TX Out of frames in pool\n\r",
+           *STBoard.milliseconds
+        );
+      return -1;
+   }
+   out_frame = &POOL_PTR(can_frame_pool, h)->tx;
   
-   out_frame.header.ext = FALSE;
-   out_frame.header.Id = STBoard.can_address;
+   out_frame->header.ext = FALSE;
+   out_frame->header.rtr = FALSE;
+   out_frame->header.Priority = priority;
+   out_frame->header.Id = id;
+   out_frame->timestamp = lat_now();
+   out_frame->counter = 0;
   
-   // Trusting the caller too much, no bounds checking here ...
-   memcpy(out_frame.data, mydata, size*8 );  // magic number 8 = bytes
-//   COPY_ARRAY(out_frame.data, mydata, size);  // See util.h for safe implementation
+   memcpy(out_frame->data, mydata, size );
+//   COPY_ARRAY(out_frame->data, mydata, size);  // See util.h for safe implementation
 
-   out_frame.header.Length = size;
+   out_frame->header.Length = size;
  
-   if ( tx_ring_buf_push_refd(&out_frame) )
+   if ( tx_ring_buf_push_refd(&h) )
    {
+      POOL_FREE(can_frame_pool, h);
       fprintf(RS232_U1,"[%8Ld]:CAN:"
            "TX Buffer is Full\n\r",
            *STBoard.milliseconds
         );
       return -1;  // find a better place for errors
    } 
+   return 0;
 }
 
-void can_setup()
+// Same as can_pack_id_prio() at CAN_TX_PRIORITY
+int16_t can_pack_id ( uint32_t id, uint8_t mydata[], uint8_t size )
+{
+   return can_pack_id_prio(id, mydata, size, CAN_TX_PRIORITY);
+}
+
+int16_t can_pack ( uint8_t mydata[], uint8_t size )
+{
+   return can_pack_id(STBoard.can_address, mydata, size);
+}
+
+#include "isotp.c"    // multi-frame transport, needs can_pack_id and the rings
+#include "cyclic.c"   // periodic TX table, needs can_pack_id
+#ifndef CAN_BACKEND_SOCKETCAN
+#include "canbaud.h"  // stops the build when CAN_BAUD_RATE is unreachable
+#include "canbaud.c"
+#include "rtr.c"      // hardware answered remote frames
+#endif
+#if USE_CAN2_PERIPHERAL == TRUE
+#include "gateway.c"  // CAN1 <-> CAN2 forwarding, needs the CAN2 rings
+#endif
+
+// Start-up is split so the receiver runs as early as possible: the ECAN is
+// listening and filling rx_ring_buf once can_setup_early() returns and global
+// interrupts are on, while can_setup_late() and the rest of the application
+// initialise. Nothing the RX ISR touches is set up in the late stage.
+void can_setup_early()
 {
+   fr_boot();  // first, keeps the trace from before a die() reset
    STBoard.can_msg_tx = 0;
    STBoard.can_msg_rx = 0;
+   POOL_FLUSH(can_frame_pool);
    CIRCBUF_FLUSH(rx_ring_buf);
    CIRCBUF_FLUSH(tx_ring_buf);
+#ifdef CAN_RX_BCAST_READERS
+   CIRCBUF_BCAST_FLUSH(rx_bcast_buf);
+#endif
+   lat_init();
+   memset(&can_boot, 0, sizeof(can_boot));
+   can_boot.start = lat_now();
+#ifdef CAN_RX_FILTER
+   rxf_init();
+#endif
+#ifdef CIRCBUF_ENABLE_NOTIFY
+   CIRCBUF_SET_WATERMARK(rx_ring_buf, 3 * rx_ring_buf.size / 4);  // falling behind
+#endif
    
    STBoard.can_address = 0xFF;
    
-   can_init();  // their version
+   if ( CAN_HW_INIT() )  // their version on the PIC
+   {
+      fprintf(RS232_U1,
+         "[%8Ld]:CAN:"
+         "ERROR: Controller did not come up!"
+         "\n\r",
+         *STBoard.milliseconds
+      );
+      return;
+   }
+#ifndef CAN_BACKEND_SOCKETCAN
+   can_bt_apply();  // the checked timing, over whatever can_init searched for
+   rtr_init();  // after can_init, it resets the buffers
   
 //   enable_interrupts(INT_CAN1);    // interrupt driven CAN messages
                                    // triggering on send AND receive
    can_enable_interrupts(CAN_INTERRUPT_RX);
    can_enable_fifo_interrupts(CAN_OBJECT_FIFO_1, CAN_FIFO_INTERRUPT_RXNE);
    enable_interrupts(INT_C1RX);
+#endif
+   // with the receiver, overflows in the window before can_setup_late() count,
+   // and its statistics reset can't wipe frame errors counted after it
+   can_err_init();
+   can_boot.rx_on = lat_now();
+}
+
+// Everything the RX path does not need: transports, TX scheduling, logging
+// and CAN2.
+void can_setup_late()
+{
+   isotp_init();
+   cyc_init();
+#ifdef CAN_LOG_BINARY
+   canlog_init(&can_log);
+#endif
+
+#if USE_CAN2_PERIPHERAL == TRUE
+   CIRCBUF_FLUSH(rx2_ring_buf);
+   CIRCBUF_FLUSH(tx2_ring_buf);
+   gw_init();
+   can2_init();
+   can2_enable_interrupts(CAN_INTERRUPT_RX);
+   enable_interrupts(INT_C2RX);
+#endif
+   can_boot.ready = lat_now();
+   can_boot.done = TRUE;
+}
+
+// Both stages back to back, for applications that don't care when the receiver
+// starts. Frames only reach rx_ring_buf once global interrupts are on, so the
+// early start needs the application to call the stages itself:
+//
+//   can_setup_early();
+//   enable_interrupts(GLOBAL);
+//   ... the rest of the application's initialisation ...
+//   can_setup_late();
+void can_setup()
+{
+   can_setup_early();
+   can_setup_late();
 }
 
 // TODO : Defined based on the battery type and other peripherals on the line
@@ -169,6 +548,13 @@ int16_t can_tx()
 {
 
    int16_t total_msg;
+   uint8_t budget;
+   uint8_t deferred;
+   uint8_t i;
+
+   isotp_poll();  // queue any consecutive frames that are due
+   CAN_HW_TX_FLUSH();  // whatever the backend could not send last call
+
    total_msg = tx_ring_buf.push_count - tx_ring_buf.pop_count;
    
    if (total_msg < 0)  // if we have looped around
@@ -177,31 +563,75 @@ int16_t can_tx()
    if (total_msg == 0)
       return -1; // Empty
 
-   for ( uint8_t i = 0 ; i < total_msg ; i++ )
+   if ( can_err_stats.state == CAN_ERR_BUS_OFF )
+      return -1;  // keep everything queued until can_err_poll() recovers
+
+   budget = can_err_tx_budget();
+   deferred = 0;
+   for ( i = 0 ; i < total_msg ; i++ )
    {
-      can_rx_frame_t temp_frame;
-      if (tx_ring_buf_pop_refd(&temp_frame))
+      pool_handle_t h;
+      can_tx_frame_t *temp_frame;
+      if (CIRCBUF_PEEK(tx_ring_buf, &h))
       {
         // Errors during sending
         fprintf(RS232_U1,"[%8Ld]:CAN:"
            "CAN Message Sending Error\n\r",
            *STBoard.milliseconds
         );
+        break;
       }
+      temp_frame = &POOL_PTR(can_frame_pool, h)->tx;
 
-      fprintf(RS232_U1,"[%8Ld]:CAN:"
-           "Data:",
-           *STBoard.milliseconds
-      );
-      for ( uint8_t j = 0 ; j < temp_frame.header.Length ; j++ )
+      // Error passive: only a few low priority frames per call. The rest go
+      // to the back of the ring so the higher priority frames behind them
+      // still get out.
+      if ( temp_frame->header.Priority < CAN_ERR_MIN_PRIORITY && budget != 0xFF )
+      {
+         if ( budget == 0 )
+         {
+            CIRCBUF_POP(tx_ring_buf, NULL);
+            tx_ring_buf_push_refd(&h);  // can't fail, the pop made room
+            can_err_stats.throttled++;
+            deferred++;
+            continue;
+         }
+         budget--;
+      }
+
+      if ( CAN_HW_PUTD(&temp_frame->header,temp_frame->data) != CAN_EC_OK )
+      {
+         // peripheral TX buffers full, try again next call. Frames not looked
+         // at yet follow the deferred ones so the queue keeps its order.
+         for ( ; deferred && i < total_msg ; i++ )
+         {
+            CIRCBUF_POP(tx_ring_buf, &h);
+            tx_ring_buf_push_refd(&h);
+         }
+         break;
+      }
+      CIRCBUF_POP(tx_ring_buf, NULL);
+
+      // A line takes ~4 ms at 115200 baud, far longer than the frame takes
+      // on the bus. Forwarded frames come at bus load, they are not printed.
+      if ( temp_frame->counter != CAN_TX_FORWARDED )
       {
-         fprintf(RS232_U1," %LX", temp_frame.data[j] );
+         fprintf(RS232_U1,"[%8Ld]:CAN:"
+              "Data:",
+              *STBoard.milliseconds
+         );
+         for ( uint8_t j = 0 ; j < temp_frame->header.Length ; j++ )
+         {
+            fprintf(RS232_U1," %LX", temp_frame->data[j] );
+         }
+         fprintf(RS232_U1, "\r\n" );
       }
-      fprintf(RS232_U1, "\r\n" );
-      can_putd(&temp_frame.header,temp_frame.data);
+      POOL_FREE(can_frame_pool, h);
 
       STBoard.can_msg_tx++;
    }
+   CAN_HW_TX_FLUSH();
+   return 0;
 }
 //!
 //!void can_rx()
@@ -215,11 +645,13 @@ int16_t can_tx()
 can_rx_frame_t can_unpack ( CAN_RX_HEADER *header , uint8_t *Data )
 {
    can_rx_frame_t frame;
-   frame.header = header;
+   frame.header = *header;
+   memcpy(frame.data, Data, header->Length);
 
    return frame;
 }
 
+int16_t can_print_rx_msg();
 
 int16_t can_print_rx_buffer()
 {
@@ -247,11 +679,37 @@ int16_t can_print_rx_buffer()
    return 0;
 }
 
+#ifdef CAN_LOG_BINARY
+// Compressed binary log instead of text lines, on CAN_LOG_STREAM so nothing
+// else is mixed in. Decode with tools/canlog_decode
+static void can_log_frame ( can_rx_frame_t *frame )
+{
+   uint8_t out[CANLOG_MAX_RECORD + 6];
+   uint8_t n;
+   uint32_t ms;
+
+   // When the ISR read the frame, not when it got printed. Taken back from
+   // its age so it stays on the millisecond clock across the wrap of the
+   // 32 bit tick counter, and never before the last record since the sync
+   ms = *STBoard.milliseconds - lat_ticks_to_us(lat_now() - frame->timestamp) / 1000;
+   if (can_log.since_sync < CANLOG_SYNC_EVERY && (int32_t)(ms - can_log.last_ms) < 0)
+      ms = can_log.last_ms;
+   n = canlog_encode(&can_log, ms, frame->header.Id,
+                     frame->header.ext, frame->header.Length, frame->data, out);
+   for ( uint8_t i = 0 ; i < n ; i++ )
+   {
+      fputc(out[i], CAN_LOG_STREAM);
+   }
+}
+#endif
+
 int16_t can_print_rx_msg()
 {
-   can_rx_frame_t temp_frame;
+   pool_handle_t h;
+   can_rx_frame_t *temp_frame;
 
-   if (rx_ring_buf_pop_refd(&temp_frame))
+   h = can_rx_take();
+   if (h == POOL_NONE)
    {
         fprintf(RS232_U1,"[%8Ld]:CAN:"
            "RX Buffer is empty\n\r",
@@ -259,18 +717,137 @@ int16_t can_print_rx_msg()
         );
       return -1;  // find a better place for errors
    }
+   temp_frame = &POOL_PTR(can_frame_pool, h)->rx;
 
-   if ( temp_frame.errors != CAN_EC_OK )  // error checking
+   if ( temp_frame->errors != CAN_EC_OK )  // error checking
+   {
+      can_handle_err(temp_frame->errors);
+   }
+   if ( isotp_rx_frame(temp_frame) <= 0 )
    {
-      can_handle_err(temp_frame.errors);
+      POOL_FREE(can_frame_pool, h);
+      return 0;  // segment of a longer message, read it with isotp_receive()
    }
+#if USE_CAN2_PERIPHERAL == TRUE
+   if ( gw_route(GW_CAN1, h) <= 0 )
+   {
+      return 0;  // handed to the gateway, no longer ours
+   }
+#endif
+#ifdef CAN_LOG_BINARY
+   can_log_frame(temp_frame);
+#else
    fprintf(RS232_U1,
       "[%8Ld]:CAN: Received msg num[%Ld] from [%LX]:",
-      *STBoard.milliseconds, temp_frame.counter, temp_frame.header.Id );
-   for ( uint8_t j = 0 ; j < temp_frame.header.Length ; j++ )
+      *STBoard.milliseconds, temp_frame->counter, temp_frame->header.Id );
+   for ( uint8_t j = 0 ; j < temp_frame->header.Length ; j++ )
    {
-      fprintf(RS232_U1," %LX", temp_frame.data[j] );
+      fprintf(RS232_U1," %LX", temp_frame->data[j] );
    }
    fprintf(RS232_U1, "\r\n" );
+#endif
+   POOL_FREE(can_frame_pool, h);
    return 0;
 }
+
+// Time frames spent in rx_ring_buf between the ISR and can_rx_take()
+void can_print_latency()
+{
+   fprintf(RS232_U1,
+      "[%8Ld]:CAN:RX queueing us: n[%Lu] p50[%Lu] p99[%Lu] max[%Lu]\r\n",
+      *STBoard.milliseconds, lat_hist.count, lat_percentile_us(50),
+      lat_percentile_us(99), lat_max_us() );
+}
+
+// Start-up timing counted from lat_init(): receiver on, late stage done and
+// the first frame, then how many frames waited in rx_ring_buf meanwhile
+void can_print_boot()
+{
+   fprintf(RS232_U1,
+      "[%8Ld]:CAN:boot us: rx_on[%Lu] ready[%Lu] first_rx[",
+      *STBoard.milliseconds, lat_ticks_to_us(can_boot.rx_on - can_boot.start),
+      lat_ticks_to_us(can_boot.ready - can_boot.start) );
+   if ( can_boot.got_rx )
+      fprintf(RS232_U1, "%Lu", lat_ticks_to_us(can_boot.first_rx - can_boot.start));
+   else
+      fprintf(RS232_U1, "-");
+   fprintf(RS232_U1, "] buffered[%lu/%d]\r\n", can_boot.early_frames,
+      rx_ring_buf.size );
+}
+
+// Lists the frames waiting in rx_ring_buf and tx_ring_buf, oldest first,
+// without taking them: one pass over the ring slots, nothing is popped
+void can_print_queues()
+{
+   circbuf_span_t spans;
+   int16_t n;
+   uint32_t now = lat_now();
+
+   n = CIRCBUF_SPANS(rx_ring_buf, &spans);
+   fprintf(RS232_U1, "[%8Ld]:CAN:rx queued[%ld]\r\n", *STBoard.milliseconds, n);
+   CIRCBUF_FOREACH(spans, pool_handle_t, h)
+   {
+      can_rx_frame_t *frame = &POOL_PTR(can_frame_pool, *h)->rx;
+
+      fprintf(RS232_U1, "   num[%Lu] id[%LX] len[%u] waiting_us[%Lu]\r\n",
+         frame->counter, frame->header.Id, frame->header.Length,
+         lat_ticks_to_us(now - frame->timestamp) );
+   }
+
+   n = CIRCBUF_SPANS(tx_ring_buf, &spans);
+   fprintf(RS232_U1, "[%8Ld]:CAN:tx queued[%ld]\r\n", *STBoard.milliseconds, n);
+   CIRCBUF_FOREACH(spans, pool_handle_t, h)
+   {
+      can_tx_frame_t *frame = &POOL_PTR(can_frame_pool, *h)->tx;
+
+      fprintf(RS232_U1, "   id[%LX] len[%u]\r\n",
+         frame->header.Id, frame->header.Length );
+   }
+}
+
+#ifdef CAN_RX_FILTER
+void can_print_rx_filter()
+{
+   rxf_stats_t stats;
+
+   rxf_stats(&stats);
+   fprintf(RS232_U1,
+      "[%8Ld]:CAN:RX filter: passed[%Lu] repeats[%Lu] limited[%Lu]"
+      " evictions[%Lu]\r\n",
+      *STBoard.milliseconds, stats.passed, stats.repeats, stats.limited,
+      stats.evictions );
+}
+#endif
+
+#ifdef CIRCBUF_ENABLE_STATS
+static void can_print_circbuf_stats ( char *name, circbuf_stats_t *stats, int size )
+{
+   fprintf(RS232_U1,
+      "[%8Ld]:CAN:%s: push[%Lu] pop[%Lu] push_fail[%Lu] pop_fail[%Lu]"
+      " peak[%d/%d] full_ms[%Lu]\r\n",
+      *STBoard.milliseconds, name, stats->pushes, stats->pops,
+      stats->push_fails, stats->pop_fails, stats->peak, size,
+      stats->time_full );
+}
+
+// Dumps ring and frame pool usage, use it to size the rings from real traffic
+void can_print_ring_stats()
+{
+   circbuf_stats_t stats;
+
+   CIRCBUF_STATS_GET(rx_ring_buf, &stats);
+   can_print_circbuf_stats("rx", &stats, rx_ring_buf.size);
+   CIRCBUF_STATS_GET(tx_ring_buf, &stats);
+   can_print_circbuf_stats("tx", &stats, tx_ring_buf.size);
+#if USE_CAN2_PERIPHERAL == TRUE
+   CIRCBUF_STATS_GET(rx2_ring_buf, &stats);
+   can_print_circbuf_stats("rx2", &stats, rx2_ring_buf.size);
+   CIRCBUF_STATS_GET(tx2_ring_buf, &stats);
+   can_print_circbuf_stats("tx2", &stats, tx2_ring_buf.size);
+#endif
+   fprintf(RS232_U1,
+      "[%8Ld]:CAN:pool: used[%u] peak[%u/%u]\r\n",
+      *STBoard.milliseconds, POOL_USED(can_frame_pool),
+      POOL_PEAK(can_frame_pool), CAN_FRAME_POOL_SIZE );
+}
+#endif
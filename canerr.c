@@ -0,0 +1,168 @@
+#include <string.h>
+#include <stdint.h>
+
+#include "canerr.h"
+
+#ifndef CAN_BACKEND_SOCKETCAN
+#if getenv("SFR_VALID:C1EC")   // ECAN of the PIC24/dsPIC33 parts
+#word CAN_ERR_C1EC = getenv("SFR:C1EC")        // TERRCNT:RERRCNT
+#word CAN_ERR_C1INTF = getenv("SFR:C1INTF")
+#bit CAN_ERR_TXBO = CAN_ERR_C1INTF.13           // transmitter bus-off
+#else
+#error canerr.c needs the ECAN C1EC/C1INTF registers (PIC24/dsPIC33)
+#endif
+#endif
+
+can_err_stats_t can_err_stats;
+uint32_t can_err_backoff_ms;
+uint32_t can_err_since_ms;       // entered bus-off, or last recovered
+uint32_t can_err_log_ms;
+uint32_t can_err_logged;         // err_irqs + rx_overflows at the last log line
+
+// Reads the error counters. Runs in the ISR, main calls it under
+// CIRCBUF_LOCK() so the two never update the state at once
+static void can_err_sample()
+{
+   uint16_t ec = CAN_HW_ERR_COUNTERS();
+   uint8_t state;
+
+   can_err_stats.tec = ec >> 8;
+   can_err_stats.rec = ec & 0xFF;
+   if (can_err_stats.tec > can_err_stats.tec_peak)
+      can_err_stats.tec_peak = can_err_stats.tec;
+   if (can_err_stats.rec > can_err_stats.rec_peak)
+      can_err_stats.rec_peak = can_err_stats.rec;
+
+   if (CAN_HW_BUS_OFF())
+      state = CAN_ERR_BUS_OFF;
+   else if (can_err_stats.tec >= 128 || can_err_stats.rec >= 128)
+      state = CAN_ERR_PASSIVE;
+   else if (can_err_stats.tec >= 96 || can_err_stats.rec >= 96)
+      state = CAN_ERR_WARNING;
+   else
+      state = CAN_ERR_ACTIVE;
+
+   if (state == CAN_ERR_PASSIVE && can_err_stats.state < CAN_ERR_PASSIVE)
+      can_err_stats.passive_entries++;
+   can_err_stats.state = state;
+}
+
+#ifndef CAN_BACKEND_SOCKETCAN
+#INT_CAN1
+void can_err_isr()
+{
+   // Counting only, printing from here would starve the CPU on a bad bus
+   if (can_interrupt_active(CAN_INTERRUPT_ERR))
+   {
+      can_err_stats.err_irqs++;
+      can_err_sample();
+      can_clear_interrupt(CAN_INTERRUPT_ERR);
+   }
+   if (can_interrupt_active(CAN_INTERRUPT_RXOV))
+   {
+      can_err_stats.rx_overflows++;
+      can_clear_interrupt(CAN_INTERRUPT_RXOV);
+   }
+#ifdef LP_CAN_WAKE
+   if (can_interrupt_active(CAN_INTERRUPT_WAKE))
+   {
+      lp_stats.can_wakes++;  // lp_sleep_until_bus() restarts the ECAN
+      can_clear_interrupt(CAN_INTERRUPT_WAKE);
+   }
+#endif
+}
+#endif
+
+void can_err_init()
+{
+   memset(&can_err_stats, 0, sizeof(can_err_stats));
+   can_err_backoff_ms = CAN_ERR_BACKOFF_MIN_MS;
+   can_err_since_ms = *STBoard.milliseconds - CAN_ERR_STABLE_MS;
+   can_err_log_ms = *STBoard.milliseconds;
+   can_err_logged = 0;
+
+#ifndef CAN_BACKEND_SOCKETCAN
+   can_enable_interrupts(CAN_INTERRUPT_ERR | CAN_INTERRUPT_RXOV);
+   enable_interrupts(INT_CAN1);
+#endif
+}
+
+static void can_err_log(char *what)
+{
+   uint32_t err_irqs, rx_overflows;
+
+   // 32 bit counters the ISR updates, don't print half of an increment
+   CIRCBUF_LOCK();
+   err_irqs = can_err_stats.err_irqs;
+   rx_overflows = can_err_stats.rx_overflows;
+   CIRCBUF_UNLOCK();
+
+   fprintf(RS232_U1,
+      "[%8Ld]:CAN:%s TEC[%u] REC[%u] err_irq[%Lu] rx_ovf[%Lu] bus_off[%Lu]\r\n",
+      *STBoard.milliseconds, what, can_err_stats.tec, can_err_stats.rec,
+      err_irqs, rx_overflows, can_err_stats.bus_offs );
+   can_err_log_ms = *STBoard.milliseconds;
+   can_err_logged = err_irqs + rx_overflows;
+}
+
+void can_err_poll()
+{
+   static uint8_t last_state = CAN_ERR_ACTIVE;
+   uint32_t now = *STBoard.milliseconds;
+   uint32_t errors;
+
+   CIRCBUF_LOCK();
+   can_err_sample();
+   errors = can_err_stats.err_irqs + can_err_stats.rx_overflows;
+   CIRCBUF_UNLOCK();
+
+   if (can_err_stats.state != last_state)
+   {
+      if (can_err_stats.state == CAN_ERR_BUS_OFF)
+      {
+         can_err_stats.bus_offs++;
+         fr_event(FR_EVT_BUS_OFF, ((uint16_t)can_err_stats.tec << 8) | can_err_stats.rec);
+         // Falling off again soon after a recovery, wait longer this time
+         if (now - can_err_since_ms < CAN_ERR_STABLE_MS)
+         {
+            can_err_backoff_ms *= 2;
+            if (can_err_backoff_ms > CAN_ERR_BACKOFF_MAX_MS)
+               can_err_backoff_ms = CAN_ERR_BACKOFF_MAX_MS;
+         }
+         else
+            can_err_backoff_ms = CAN_ERR_BACKOFF_MIN_MS;
+         can_err_since_ms = now;
+      }
+      last_state = can_err_stats.state;
+      can_err_log(can_err_stats.state == CAN_ERR_BUS_OFF ? "BUS-OFF" :
+                  can_err_stats.state == CAN_ERR_PASSIVE ? "Error passive" :
+                  can_err_stats.state == CAN_ERR_WARNING ? "Error warning" :
+                  "Error active");
+   }
+   else if (errors != can_err_logged && now - can_err_log_ms >= CAN_ERR_LOG_MS)
+   {
+      can_err_log("Errors");
+   }
+
+   if (can_err_stats.state == CAN_ERR_BUS_OFF &&
+       now - can_err_since_ms >= can_err_backoff_ms)
+   {
+      // Restart the controller, it rejoins after 128 x 11 recessive bits
+      CAN_HW_RESTART();
+      can_err_stats.recoveries++;
+      can_err_since_ms = now;
+   }
+}
+
+uint8_t can_err_tx_budget()
+{
+   switch (can_err_stats.state)
+   {
+   case CAN_ERR_BUS_OFF:
+      return 0;
+   case CAN_ERR_PASSIVE:
+      return CAN_ERR_PASSIVE_BUDGET;
+   default:
+      return 0xFF;
+   }
+}
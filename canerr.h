@@ -0,0 +1,100 @@
+#ifndef _CANERR_H_
+#define _CANERR_H_
+
+#include <stdint.h>
+
+// Bus error monitoring. The CAN1 error and RX overflow interrupts sample the
+// error counters, can_err_poll() tracks the fault confinement state, brings
+// the controller back after bus-off with a growing back-off, and can_tx()
+// asks can_err_tx_budget() how much traffic the bus can take right now.
+
+typedef enum
+{
+   CAN_ERR_ACTIVE = 0,
+   CAN_ERR_WARNING,           // TEC or REC >= 96
+   CAN_ERR_PASSIVE,           // TEC or REC >= 128
+   CAN_ERR_BUS_OFF            // TEC > 255, controller is off the bus
+} can_err_state_t;
+
+typedef struct
+{
+   uint8_t state;             // can_err_state_t
+   uint8_t tec;               // transmit error counter, last sample
+   uint8_t rec;               // receive error counter, last sample
+   uint8_t tec_peak;
+   uint8_t rec_peak;
+   uint32_t err_irqs;
+   uint32_t rx_overflows;     // frames lost in the peripheral
+   uint32_t passive_entries;
+   uint32_t bus_offs;
+   uint32_t recoveries;
+   uint32_t frame_errors;     // frames popped with errors != CAN_EC_OK
+   uint32_t throttled;        // low priority frames can_tx() deferred
+} can_err_stats_t;
+
+/**
+ * Description:
+ *   Low priority frames (header.Priority below this) queued by can_tx() per
+ *   call while error passive, the others wait for the next call. Higher
+ *   priorities are never throttled and overtake the waiting ones.
+ */
+#ifndef CAN_ERR_PASSIVE_BUDGET
+#define CAN_ERR_PASSIVE_BUDGET    2
+#endif
+
+#ifndef CAN_ERR_MIN_PRIORITY
+#define CAN_ERR_MIN_PRIORITY      2
+#endif
+
+/**
+ * Description:
+ *   Bus-off back-off in ms. Each bus-off within CAN_ERR_STABLE_MS of the last
+ *   recovery doubles the wait, up to the maximum.
+ */
+#ifndef CAN_ERR_BACKOFF_MIN_MS
+#define CAN_ERR_BACKOFF_MIN_MS    100
+#endif
+
+#ifndef CAN_ERR_BACKOFF_MAX_MS
+#define CAN_ERR_BACKOFF_MAX_MS    5000
+#endif
+
+#ifndef CAN_ERR_STABLE_MS
+#define CAN_ERR_STABLE_MS         10000
+#endif
+
+/**
+ * Description:
+ *   Minimum time between error log lines, everything in between is only
+ *   counted.
+ */
+#ifndef CAN_ERR_LOG_MS
+#define CAN_ERR_LOG_MS            1000
+#endif
+
+/**
+ * Description:
+ *   Clears the statistics and enables the error and overflow interrupts.
+ *   Call after can_init().
+ */
+void can_err_init();
+
+/**
+ * Description:
+ *   Updates the error state, recovers from bus-off once the back-off has
+ *   passed and logs state changes. Call from a periodic task.
+ */
+void can_err_poll();
+
+/**
+ * Description:
+ *   Number of low priority frames can_tx() may load right now.
+ *
+ * Returns (uint8_t):
+ *   0           - Bus-off, send nothing
+ *   1..254      - Error passive budget
+ *   255         - No limit
+ */
+uint8_t can_err_tx_budget();
+
+#endif /* _CANERR_H_ */
@@ -0,0 +1,44 @@
+#ifndef _CANFRAME_H_
+#define _CANFRAME_H_
+
+#include <stdint.h>
+
+// Frame types of the canbus layer. Kept apart from canbus.c so host tools
+// (tools/cantrace.c) decode into the very same structs. Needs can_ec_t and the
+// CAN_RX_HEADER / CAN_TX_HEADER of the ECAN driver, or of socketcan.h on the
+// host.
+
+// CCS C requires different headers for send and receive
+// Hence the need for 2 frame types
+// The payload comes first in both so the RX and TX views of a pooled frame
+// (can_frame_t) share it, and forwarding only rewrites the header.
+typedef struct
+{
+   uint8_t data[8];        // data storage for message
+   can_ec_t errors;        // error codes for message
+   uint32_t counter;        // tracking num. via STBoard.can_msg_rx counter.
+   uint32_t timestamp;      // lat_now() when the ISR read the frame
+   CAN_RX_HEADER header;   // see the CAN oject definition in can-pic18_fd.h
+                           //   length of data is in his header object
+                           //   and is size uint8_t -- 1 byte
+} can_rx_frame_t;
+
+typedef struct
+{
+   uint8_t data[8];         // data storage message
+   can_ec_t errors;        // error codes for message
+   uint32_t counter;        // CAN_TX_FORWARDED when can_forward() queued it
+   uint32_t timestamp;      // kept from the RX frame when forwarded
+   CAN_TX_HEADER header;    // see the CAN oject definition in can-pic18_fd.h
+                            //   length of the data is in this header object
+} can_tx_frame_t;
+
+#define CAN_TX_FORWARDED   0xFFFFFFFF
+
+typedef union
+{
+   can_rx_frame_t rx;
+   can_tx_frame_t tx;
+} can_frame_t;
+
+#endif /* _CANFRAME_H_ */
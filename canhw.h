@@ -0,0 +1,46 @@
+#ifndef _CANHW_H_
+#define _CANHW_H_
+
+// The few controller operations the canbus layer needs, so the same
+// can_setup() / can_pack() / can_tx() / can_rx_isr() run on the PIC ECAN
+// driver or, with CAN_BACKEND_SOCKETCAN, on a Linux SocketCAN interface.
+//
+//   CAN_HW_INIT()            bring the controller up, 0 on success
+//   CAN_HW_KBHIT()           a received frame is waiting
+//   CAN_HW_RX_STAMP()        lat_now() time the waiting frame arrived
+//   CAN_HW_GETD(hdr, data)   read the waiting frame, can_ec_t
+//   CAN_HW_PUTD(hdr, data)   queue a frame for transmission, can_ec_t
+//   CAN_HW_TX_FLUSH()        push queued frames out, end of can_tx()
+//   CAN_HW_ERR_COUNTERS()    TEC << 8 | REC
+//   CAN_HW_BUS_OFF()         TRUE while the controller is bus-off
+//   CAN_HW_RESTART()         leave bus-off
+
+#ifdef CAN_BACKEND_SOCKETCAN
+
+#include "socketcan.h"
+
+#define CAN_HW_INIT()            sc_open(SC_IFNAME)
+#define CAN_HW_KBHIT()           sc_kbhit()
+#define CAN_HW_RX_STAMP()        sc_rx_stamp()
+#define CAN_HW_GETD(hdr, data)   sc_getd(hdr, data)
+#define CAN_HW_PUTD(hdr, data)   sc_putd(hdr, data)
+#define CAN_HW_TX_FLUSH()        sc_flush()
+#define CAN_HW_ERR_COUNTERS()    sc_err.ec
+#define CAN_HW_BUS_OFF()         sc_err.bus_off
+#define CAN_HW_RESTART()         /* the kernel does it, see SC_IFNAME */
+
+#else
+
+#define CAN_HW_INIT()            (can_init(), 0)
+#define CAN_HW_KBHIT()           can_kbhit()
+#define CAN_HW_RX_STAMP()        lat_now()
+#define CAN_HW_GETD(hdr, data)   can_getd(hdr, data, CAN_OBJECT_FIFO_1)
+#define CAN_HW_PUTD(hdr, data)   can_putd(hdr, data)
+#define CAN_HW_TX_FLUSH()        /* can_putd loads the TX buffer directly */
+#define CAN_HW_ERR_COUNTERS()    CAN_ERR_C1EC
+#define CAN_HW_BUS_OFF()         CAN_ERR_TXBO
+#define CAN_HW_RESTART()         do { can_set_mode(CAN_OP_CONFIG); can_set_mode(CAN_OP_NORMAL); } while(0)
+
+#endif
+
+#endif /* _CANHW_H_ */
@@ -0,0 +1,184 @@
+#include <string.h>
+#include <stdint.h>
+
+#include "canlog.h"
+
+void canlog_init(canlog_t *log)
+{
+   memset(log, 0, sizeof(canlog_t));
+   log->since_sync = CANLOG_SYNC_EVERY;  // force a sync first
+}
+
+static uint8_t canlog_put_varint(uint8_t *out, uint32_t v)
+{
+   uint8_t n = 0;
+
+   while (v >= 0x80) {
+      out[n++] = (v & 0x7F) | 0x80;
+      v >>= 7;
+   }
+   out[n++] = v;
+   return n;
+}
+
+// Returns bytes used, 0 if more input is needed, -1 if longer than 5 bytes
+static int8_t canlog_get_varint(uint8_t *in, uint16_t len, uint32_t *v)
+{
+   uint8_t n = 0;
+
+   *v = 0;
+   while (n < len && n < 5) {
+      *v |= (uint32_t)(in[n] & 0x7F) << (7 * n);
+      if (!(in[n++] & 0x80))
+         return n;
+   }
+   return n < 5 ? 0 : -1;
+}
+
+static int8_t canlog_find(canlog_t *log, uint32_t id, uint8_t ext)
+{
+   for (uint8_t i = 0; i < log->used; i++) {
+      if (log->id[i] == id && log->ext[i] == ext)
+         return i;
+   }
+   return -1;
+}
+
+uint8_t canlog_encode(canlog_t *log, uint32_t ms, uint32_t id, uint8_t ext,
+                      uint8_t dlc, uint8_t *data, uint8_t *out)
+{
+   uint8_t n = 0;
+   uint8_t mask = 0;
+   uint8_t *b0;
+   int8_t idx;
+
+   if (dlc > 8)
+      dlc = 8;
+
+   if (log->since_sync >= CANLOG_SYNC_EVERY) {
+      log->used = 0;
+      log->next = 0;
+      log->since_sync = 0;
+      log->last_ms = ms;
+      out[n++] = CANLOG_SYNC;
+      n += canlog_put_varint(&out[n], ms);
+   }
+   log->since_sync++;
+
+   b0 = &out[n++];
+   n += canlog_put_varint(&out[n], ms - log->last_ms);
+   log->last_ms = ms;
+
+   idx = canlog_find(log, id, ext);
+   if (idx < 0) {
+      *b0 = (CANLOG_LITERAL << 4) | dlc;
+      n += canlog_put_varint(&out[n], (id << 1) | (ext ? 1 : 0));
+      memcpy(&out[n], data, dlc);
+      n += dlc;
+
+      idx = log->next;
+      log->next = (log->next + 1) % CANLOG_DICT_SIZE;
+      if (log->used < CANLOG_DICT_SIZE)
+         log->used++;
+      log->id[idx] = id;
+      log->ext[idx] = ext ? 1 : 0;
+      memset(log->data[idx], 0, 8);
+      memcpy(log->data[idx], data, dlc);
+      return n;
+   }
+
+   *b0 = (idx << 4) | dlc;
+   for (uint8_t i = 0; i < dlc; i++) {
+      if (data[i] != log->data[idx][i])
+         mask |= 1 << i;
+   }
+   out[n++] = mask;
+   for (uint8_t i = 0; i < dlc; i++) {
+      if (mask & (1 << i)) {
+         out[n++] = data[i] ^ log->data[idx][i];
+         log->data[idx][i] = data[i];
+      }
+   }
+   return n;
+}
+
+int16_t canlog_decode(canlog_t *log, uint8_t *in, uint16_t len, uint32_t *ms,
+                      uint32_t *id, uint8_t *ext, uint8_t *dlc, uint8_t *data)
+{
+   uint16_t n = 1;
+   uint16_t p;
+   uint32_t v;
+   int8_t r;
+   uint8_t idx, mask;
+
+   if (len == 0)
+      return 0;
+
+   if (in[0] == CANLOG_SYNC) {
+      r = canlog_get_varint(&in[1], len - 1, &v);
+      if (r <= 0)
+         return r;
+      log->used = 0;
+      log->next = 0;
+      log->last_ms = v;
+      *ms = v;
+      *dlc = CANLOG_SYNC;
+      return 1 + r;
+   }
+
+   idx = in[0] >> 4;
+   *dlc = in[0] & 0x0F;
+   if (*dlc > 8 || (idx != CANLOG_LITERAL && idx >= log->used))
+      return -1;
+
+   r = canlog_get_varint(&in[n], len - n, &v);
+   if (r <= 0)
+      return r;
+   n += r;
+   *ms = log->last_ms + v;
+
+   if (idx == CANLOG_LITERAL) {
+      r = canlog_get_varint(&in[n], len - n, &v);
+      if (r <= 0)
+         return r;
+      n += r;
+      if (len - n < *dlc)
+         return 0;
+      *id = v >> 1;
+      *ext = v & 1;
+      memset(data, 0, 8);
+      memcpy(data, &in[n], *dlc);
+      n += *dlc;
+
+      log->last_ms = *ms;
+      idx = log->next;
+      log->next = (log->next + 1) % CANLOG_DICT_SIZE;
+      if (log->used < CANLOG_DICT_SIZE)
+         log->used++;
+      log->id[idx] = *id;
+      log->ext[idx] = *ext;
+      memcpy(log->data[idx], data, 8);
+      return n;
+   }
+
+   if (n >= len)
+      return 0;
+   mask = in[n++];
+   p = n;
+   for (uint8_t i = 0; i < *dlc; i++) {
+      if (mask & (1 << i))
+         n++;
+   }
+   if (n > len)
+      return 0;  // only commit once the whole record is there
+
+   for (uint8_t i = 0; i < *dlc; i++) {
+      if (mask & (1 << i))
+         log->data[idx][i] ^= in[p++];
+   }
+   log->last_ms = *ms;
+   *id = log->id[idx];
+   *ext = log->ext[idx];
+   memcpy(data, log->data[idx], 8);
+   return n;
+}
@@ -0,0 +1,77 @@
+#ifndef _CANLOG_H_
+#define _CANLOG_H_
+
+#include <stdint.h>
+
+// Compact binary CAN log format, for pushing full bus traffic through a
+// 115200 baud UART. The stream must carry nothing but records, canbus.c
+// writes it to its own UART (CAN_LOG_STREAM). Plain C, shared by the
+// firmware encoder and the host decoder in tools/.
+//
+// Record:
+//   B0         (idx << 4) | dlc
+//   varint     ms since the previous record
+//   idx == 15  varint (Id << 1 | ext), then dlc raw payload bytes. The Id
+//              takes the next dictionary slot, round robin.
+//   idx < 15   Id from dictionary slot idx. Mask byte, bit n set if payload
+//              byte n changed since that Id's previous frame, then the
+//              changed bytes XORed with their previous value.
+//
+// A sync record, B0 == 0xFF followed by varint absolute ms, clears the
+// dictionary. The encoder starts with one and repeats it every
+// CANLOG_SYNC_EVERY records so a decoder can join a running stream.
+//
+// Varints are little endian base 128, high bit set on all but the last byte.
+
+#define CANLOG_DICT_SIZE      15
+#define CANLOG_LITERAL        15
+#define CANLOG_SYNC           0xFF
+#define CANLOG_MAX_RECORD     19    // B0 + 5 + 5 + 8
+
+#ifndef CANLOG_SYNC_EVERY
+#define CANLOG_SYNC_EVERY     256
+#endif
+
+typedef struct
+{
+   uint32_t id[CANLOG_DICT_SIZE];
+   uint8_t ext[CANLOG_DICT_SIZE];
+   uint8_t data[CANLOG_DICT_SIZE][8];
+   uint8_t used;              // valid dictionary slots
+   uint8_t next;              // slot the next literal Id replaces
+   uint16_t since_sync;       // records since the last sync
+   uint32_t last_ms;
+} canlog_t;
+
+/**
+ * Description:
+ *   Resets encoder or decoder state `log`. The next encoded record starts
+ *   with a sync.
+ */
+void canlog_init(canlog_t *log);
+
+/**
+ * Description:
+ *   Encodes one frame into `out`, which must hold CANLOG_MAX_RECORD plus a
+ *   sync record (6 bytes).
+ *
+ * Returns (uint8_t):
+ *   number of bytes written
+ */
+uint8_t canlog_encode(canlog_t *log, uint32_t ms, uint32_t id, uint8_t ext,
+                      uint8_t dlc, uint8_t *data, uint8_t *out);
+
+/**
+ * Description:
+ *   Decodes one record from the `len` bytes at `in`. Sync records only
+ *   update `log` and return with `*dlc` set to 0xFF.
+ *
+ * Returns (int16_t):
+ *   1..N - bytes consumed, frame in `*ms`, `*id`, `*ext`, `*dlc`, `data`
+ *   0    - Need more bytes
+ *  -1    - Corrupt record, skip to the next sync
+ */
+int16_t canlog_decode(canlog_t *log, uint8_t *in, uint16_t len, uint32_t *ms,
+                      uint32_t *id, uint8_t *ext, uint8_t *dlc, uint8_t *data);
+
+#endif /* _CANLOG_H_ */
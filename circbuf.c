@@ -9,20 +9,51 @@
 
 #include "circbuf.h"
 
+#ifdef CIRCBUF_THREADED
+#define __CIRCBUF_LOAD(x)         __atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+#define __CIRCBUF_STORE(x, v)     __atomic_store_n(&(x), (v), __ATOMIC_RELEASE)
+#else
+#define __CIRCBUF_LOAD(x)         (x)
+#define __CIRCBUF_STORE(x, v)     ((x) = (v))
+#endif
+
+// Occupancy from a push and a pop count, and the count after `n`
+#ifdef CIRCBUF_WIDE
+typedef int __circbuf_used_t;
+#define __CIRCBUF_USED(cb, push, pop)   ((int)((push) - (pop)))
+#define __CIRCBUF_NEXT(cb, n)           ((n) + 1)
+#else
+typedef int16_t __circbuf_used_t;
+#define __CIRCBUF_USED(cb, push, pop)   \
+   ((push) - (pop) + ((push) < (pop) ? 2 * (cb)->size : 0))
+#define __CIRCBUF_NEXT(cb, n)           ((n) + 1 >= 2 * (cb)->size ? 0 : (n) + 1)
+#endif
+
 int __circbuf_pop(circbuf_t *circ_buf, void *elem, int read_only)
 {
-   int16_t total;
+   __circbuf_used_t total;
+   circbuf_count_t pop_count = circ_buf->pop_count;
    char *tail;
 
-   total = circ_buf->push_count - circ_buf->pop_count;
-   if (total < 0)
-      total += (2 * circ_buf->size);
+#ifdef CIRCBUF_THREADED
+   // Only touch the producer's line when the cached view says empty
+   if (circ_buf->push_cache == pop_count)
+      circ_buf->push_cache = __CIRCBUF_LOAD(circ_buf->push_count);
+   total = __CIRCBUF_USED(circ_buf, circ_buf->push_cache, pop_count);
+#else
+   total = __CIRCBUF_USED(circ_buf, circ_buf->push_count, pop_count);
+#endif
 
-   if (total == 0)
+   if (total == 0) {
+#ifdef CIRCBUF_ENABLE_STATS
+      if (!read_only)
+         circ_buf->stats.pop_fails++;
+#endif
       return -1; // Empty
+   }
 
-   tail = (char *)circ_buf->buffer + ((circ_buf->pop_count % circ_buf->size)
-         * circ_buf->element_size);
+   tail = (char *)circ_buf->buffer + ((pop_count % circ_buf->size)
+         * (size_t)circ_buf->element_size);
 
    if (elem)
       memcpy(elem, tail, circ_buf->element_size);
@@ -31,41 +62,240 @@ int __circbuf_pop(circbuf_t *circ_buf, void *elem, int read_only)
 #ifdef CIRCBUF_CLEAN_ON_POP
       memset(tail, 0, circ_buf->element_size);
 #endif
-      circ_buf->pop_count++;
-      if (circ_buf->pop_count >= (2*circ_buf->size))
-         circ_buf->pop_count = 0;
+      __CIRCBUF_STORE(circ_buf->pop_count, __CIRCBUF_NEXT(circ_buf, pop_count));
+#ifdef CIRCBUF_ENABLE_STATS
+      circ_buf->stats.pops++;
+      // full and time_full are shared with the producer, often an ISR
+      if (circ_buf->stats.full) {
+         CIRCBUF_LOCK();
+         circ_buf->stats.time_full += CIRCBUF_STATS_CLOCK() - circ_buf->stats.full_since;
+         circ_buf->stats.full = 0;
+         CIRCBUF_UNLOCK();
+      }
+#endif
    }
    return 0;
 }
 
 int __circbuf_push(circbuf_t *circ_buf, void *elem)
 {
-   int16_t total;
+   __circbuf_used_t total;
+   circbuf_count_t push_count = circ_buf->push_count;
    char *head;
 
-   total = circ_buf->push_count - circ_buf->pop_count;
-   if (total < 0)
-      total += (2 * circ_buf->size);
+#ifdef CIRCBUF_THREADED
+   // Only touch the consumer's line when the cached view says full
+   total = __CIRCBUF_USED(circ_buf, push_count, circ_buf->pop_cache);
+   if (total >= circ_buf->size) {
+      circ_buf->pop_cache = __CIRCBUF_LOAD(circ_buf->pop_count);
+      total = __CIRCBUF_USED(circ_buf, push_count, circ_buf->pop_cache);
+   }
+#else
+   total = __CIRCBUF_USED(circ_buf, push_count, circ_buf->pop_count);
+#endif
 
-   if (total >=  circ_buf->size)
+   if (total >=  circ_buf->size) {
+#ifdef CIRCBUF_ENABLE_STATS
+      circ_buf->stats.push_fails++;
+#endif
       return -1; // Full
+   }
 
-   head = (char *)circ_buf->buffer + ( (circ_buf->push_count % circ_buf->size)
-         * circ_buf->element_size );
+   head = (char *)circ_buf->buffer + ( (push_count % circ_buf->size)
+         * (size_t)circ_buf->element_size );
    memcpy(head, elem, circ_buf->element_size);
-   circ_buf->push_count++;
-   if (circ_buf->push_count >= (2*circ_buf->size))
-      circ_buf->push_count = 0;
+   // publish after the copy
+   __CIRCBUF_STORE(circ_buf->push_count, __CIRCBUF_NEXT(circ_buf, push_count));
+#ifdef CIRCBUF_ENABLE_STATS
+   circ_buf->stats.pushes++;
+   if (total + 1 > circ_buf->stats.peak)
+      circ_buf->stats.peak = total + 1;
+   if (total + 1 == circ_buf->size) {
+      CIRCBUF_LOCK();
+      circ_buf->stats.full_since = CIRCBUF_STATS_CLOCK();
+      circ_buf->stats.full = 1;
+      CIRCBUF_UNLOCK();
+   }
+#endif
+#ifdef CIRCBUF_ENABLE_NOTIFY
+   if (total == 0) {
+      circ_buf->events |= CIRCBUF_EVT_NONEMPTY;
+      CIRCBUF_ON_EVENT(circ_buf, CIRCBUF_EVT_NONEMPTY);
+   }
+   if (total + 1 == circ_buf->watermark) {
+      circ_buf->events |= CIRCBUF_EVT_WATERMARK;
+      CIRCBUF_ON_EVENT(circ_buf, CIRCBUF_EVT_WATERMARK);
+   }
+#endif
    return 0;
 }
 
+int __circbuf_push_overwrite(circbuf_t *circ_buf, void *elem)
+{
+   if (__circbuf_free_space(circ_buf) == 0 && circ_buf->size)
+      circ_buf->pop_count = __CIRCBUF_NEXT(circ_buf, circ_buf->pop_count); // drop the oldest
+   return __circbuf_push(circ_buf, elem);
+}
+
 int __circbuf_free_space(circbuf_t *circ_buf)
 {
-   int16_t total;
+   circbuf_count_t push_count = __CIRCBUF_LOAD(circ_buf->push_count);
+   circbuf_count_t pop_count = __CIRCBUF_LOAD(circ_buf->pop_count);
+
+   return circ_buf->size - __CIRCBUF_USED(circ_buf, push_count, pop_count);
+}
+
+// Elements from cursor `from` up to cursor `to`
+static uint16_t __circbuf_bcast_dist(circbuf_bcast_t *circ_buf, uint16_t from, uint16_t to)
+{
+   return to >= from ? to - from : to + circ_buf->wrap - from;
+}
+
+int __circbuf_bcast_push(circbuf_bcast_t *circ_buf, void *elem)
+{
+   uint16_t head = circ_buf->head;
+   uint16_t tail;
+   char *slot;
 
-   total = circ_buf->push_count - circ_buf->pop_count;
-   if (total < 0)
-      total += (2 * circ_buf->size);
+   if (!circ_buf->overwrite) {
+      for (int i = 0; i < circ_buf->readers; i++) {
+         CIRCBUF_LOCK();
+         tail = circ_buf->tails[i];
+         CIRCBUF_UNLOCK();
+         if (__circbuf_bcast_dist(circ_buf, tail, head) >= circ_buf->size)
+            return -1; // Full for reader i
+      }
+   }
 
-   return circ_buf->size - total;
+   slot = (char *)circ_buf->buffer + ((head % circ_buf->size)
+         * circ_buf->element_size);
+   memcpy(slot, elem, circ_buf->element_size);
+   head = head + 1 == circ_buf->wrap ? 0 : head + 1;
+   CIRCBUF_LOCK();
+   circ_buf->head = head;  // publish only once the copy is complete
+   CIRCBUF_UNLOCK();
+   return 0;
 }
+
+int __circbuf_bcast_pop(circbuf_bcast_t *circ_buf, int reader, void *elem)
+{
+   uint16_t tail = circ_buf->tails[reader];
+   uint16_t head;
+   int lapped = 0;
+   char *slot;
+
+   for (;;) {
+      // 16 bits, not a single load on the PIC
+      CIRCBUF_LOCK();
+      head = circ_buf->head;
+      CIRCBUF_UNLOCK();
+      if (head == tail)
+         return -1; // Empty
+
+      // With overwrite only head-size+1 .. head-1 are stable, the writer may
+      // be busy with slot head
+      if (circ_buf->overwrite &&
+          __circbuf_bcast_dist(circ_buf, tail, head) >= circ_buf->size) {
+         tail = head >= circ_buf->size - 1 ? head - (circ_buf->size - 1)
+                                           : head + circ_buf->wrap - (circ_buf->size - 1);
+         lapped = 1;
+      }
+
+      slot = (char *)circ_buf->buffer + ((tail % circ_buf->size)
+            * circ_buf->element_size);
+      if (elem)
+         memcpy(elem, slot, circ_buf->element_size);
+
+      if (!circ_buf->overwrite)
+         break;
+      // Lapped while copying, the element may be torn: try again
+      CIRCBUF_LOCK();
+      head = circ_buf->head;
+      CIRCBUF_UNLOCK();
+      if (__circbuf_bcast_dist(circ_buf, tail, head) < circ_buf->size)
+         break;
+   }
+
+   tail = tail + 1 == circ_buf->wrap ? 0 : tail + 1;
+   CIRCBUF_LOCK();
+   circ_buf->tails[reader] = tail;
+   CIRCBUF_UNLOCK();
+   return lapped;
+}
+
+int __circbuf_bcast_count(circbuf_bcast_t *circ_buf, int reader)
+{
+   uint16_t head, tail, used;
+
+   CIRCBUF_LOCK();
+   head = circ_buf->head;
+   tail = circ_buf->tails[reader];
+   CIRCBUF_UNLOCK();
+   used = __circbuf_bcast_dist(circ_buf, tail, head);
+   if (circ_buf->overwrite && used >= circ_buf->size)
+      return circ_buf->size - 1;
+   return used;
+}
+
+int __circbuf_spans(circbuf_t *circ_buf, circbuf_span_t *spans)
+{
+   circbuf_count_t push_count = __CIRCBUF_LOAD(circ_buf->push_count);
+   circbuf_count_t pop_count = __CIRCBUF_LOAD(circ_buf->pop_count);
+   __circbuf_used_t total;
+   int tail, first;
+
+   total = __CIRCBUF_USED(circ_buf, push_count, pop_count);
+   tail = total ? pop_count % circ_buf->size : 0;  // size 0 before CIRCBUF_HUGE_ALLOC
+   first = circ_buf->size - tail;
+   if (first > total)
+      first = total;
+
+   spans->first = (char *)circ_buf->buffer + tail * (size_t)circ_buf->element_size;
+   spans->first_len = first;
+   spans->second = circ_buf->buffer;
+   spans->second_len = total - first;
+   return total;
+}
+
+#ifdef CIRCBUF_ENABLE_STATS
+// Both sides update the counters, a copy or reset with interrupts on could mix
+// halves of a 32 bit counter
+void __circbuf_stats(circbuf_t *circ_buf, circbuf_stats_t *stats)
+{
+   CIRCBUF_LOCK();
+   memcpy(stats, &circ_buf->stats, sizeof(circbuf_stats_t));
+   if (stats->full)
+      stats->time_full += CIRCBUF_STATS_CLOCK() - stats->full_since;
+   CIRCBUF_UNLOCK();
+}
+
+void __circbuf_stats_reset(circbuf_t *circ_buf)
+{
+   int full;
+
+   CIRCBUF_LOCK();
+   full = circ_buf->stats.full;
+   memset(&circ_buf->stats, 0, sizeof(circbuf_stats_t));
+   circ_buf->stats.peak = circ_buf->size - __circbuf_free_space(circ_buf);
+   if (full) {
+      circ_buf->stats.full = 1;
+      circ_buf->stats.full_since = CIRCBUF_STATS_CLOCK();
+   }
+   CIRCBUF_UNLOCK();
+}
+#endif
+
+#ifdef CIRCBUF_ENABLE_NOTIFY
+int __circbuf_events_take(circbuf_t *circ_buf)
+{
+   int events;
+
+   // the &= is a read-modify-write, a push from an ISR in the middle of it
+   // would have its event cleared unseen
+   CIRCBUF_LOCK();
+   events = circ_buf->events;
+   circ_buf->events = 0;
+   CIRCBUF_UNLOCK();
+   return events;
+}
+#endif
@@ -9,23 +9,191 @@
 
 #include <stdint.h>
 
+/**
+ * Description:
+ *   Keep per-buffer statistics, see CIRCBUF_STATS_GET(). Compiled out
+ *   entirely when not defined.
+ */
+// #define CIRCBUF_ENABLE_STATS
+
+/**
+ * Description:
+ *   Time source for the time-at-full statistic, any free-running counter.
+ *   Define it before including circbuf.h, the unit is whatever it counts in.
+ */
+#ifndef CIRCBUF_STATS_CLOCK
+#define CIRCBUF_STATS_CLOCK()     0
+#endif
+
+/**
+ * Description:
+ *   Raise events when a push makes the buffer non-empty or brings it up to
+ *   its watermark, see CIRCBUF_EVENTS_TAKE(). Compiled out when not defined.
+ */
+// #define CIRCBUF_ENABLE_NOTIFY
+
+#define CIRCBUF_EVT_NONEMPTY      0x01  // push into an empty buffer
+#define CIRCBUF_EVT_WATERMARK     0x02  // push reached the watermark
+
+/**
+ * Description:
+ *   Called from the push that raised event `ev` on circbuf_t `cb`, in the
+ *   pusher's context (often an ISR). Define it before including circbuf.h to
+ *   wake a consumer, e.g. rtos_enable() its task. The event is latched in
+ *   the buffer either way.
+ */
+#ifndef CIRCBUF_ON_EVENT
+#define CIRCBUF_ON_EVENT(cb, ev)
+#endif
+
+/**
+ * Description:
+ *   Host builds where the producer and the consumer of a buffer are different
+ *   threads. The push and pop counters move to cache lines of their own, each
+ *   side keeps a copy of the other's counter and only reads the real one when
+ *   the copy says full or empty, and counters are published with
+ *   acquire/release atomics. GCC or Clang only. Statistics, events and
+ *   CIRCBUF_PUSH_OVERWRITE still assume a single context.
+ */
+// #define CIRCBUF_THREADED
+
+#ifndef CIRCBUF_CACHE_LINE
+#define CIRCBUF_CACHE_LINE        64
+#endif
+
+/**
+ * Description:
+ *   Critical section around the few fields both a push and a pop update, so
+ *   one side can run in an ISR. The interrupt enable is saved and restored,
+ *   so it is also safe inside a handler. Sections nest (a push with stats
+ *   inside fr_event(), say): only the outermost one saves and restores. With
+ *   interrupts off no other user can be in a section, one saved copy and one
+ *   depth are enough. Host builds have no interrupts to hold off.
+ */
+#ifndef CIRCBUF_LOCK
+#if defined(__GNUC__)
+#define CIRCBUF_LOCK()
+#define CIRCBUF_UNLOCK()
+#else
+#bit __CIRCBUF_GIE = getenv("BIT:GIE")
+int1 __circbuf_gie;
+uint8_t __circbuf_depth;
+#define CIRCBUF_LOCK()                                       \
+   do {                                                      \
+      int1 gie = __CIRCBUF_GIE;                              \
+      disable_interrupts(GLOBAL);                            \
+      if (__circbuf_depth++ == 0)                            \
+         __circbuf_gie = gie;                                \
+   } while(0)
+#define CIRCBUF_UNLOCK()                                     \
+   do {                                                      \
+      if (--__circbuf_depth == 0 && __circbuf_gie)           \
+         enable_interrupts(GLOBAL);                          \
+   } while(0)
+#endif
+#endif
+
+/**
+ * Description:
+ *   Deep host buffers, above 16383 elements. The push and pop counters run
+ *   free as size_t and the occupancy is their difference, instead of int
+ *   counters wrapping at 2 * size. A 64 bit size_t never wraps in practice,
+ *   with a 32 bit one the size must be a power of two so the wrap lines up
+ *   with the slots. Sizes still have to fit an int.
+ */
+// #define CIRCBUF_WIDE
+
+#ifdef CIRCBUF_WIDE
+#include <stddef.h>
+typedef size_t circbuf_count_t;
+#else
+typedef int circbuf_count_t;
+#endif
+
 /** --- Internal methods and structures. DON'T USE --------------------------- */
+#ifdef CIRCBUF_THREADED
+#define __CIRCBUF_OWN_LINE        __attribute__((aligned(CIRCBUF_CACHE_LINE)))
+#define __CIRCBUF_CACHED(name)    circbuf_count_t name;
+#define __CIRCBUF_CACHE_INIT      0,
+#define __CIRCBUF_CACHE_FLUSH(buf)   buf.pop_cache = 0; buf.push_cache = 0;
+#else
+#define __CIRCBUF_OWN_LINE
+#define __CIRCBUF_CACHED(name)
+#define __CIRCBUF_CACHE_INIT
+#define __CIRCBUF_CACHE_FLUSH(buf)
+#endif
+
+typedef struct {
+   uint32_t pushes;
+   uint32_t pops;
+   uint32_t push_fails;    // pushes refused because the buffer was full
+   uint32_t pop_fails;     // pops refused because the buffer was empty
+   uint32_t time_full;     // total CIRCBUF_STATS_CLOCK() ticks spent full
+   uint32_t full_since;
+   int peak;               // highest occupancy seen
+   int full;
+} circbuf_stats_t;
+
 typedef struct {
    void * buffer;
-   int push_count;
-   int pop_count;
-   int size;
+   __CIRCBUF_OWN_LINE circbuf_count_t push_count;  // written by the producer
+   __CIRCBUF_CACHED(pop_cache)         // producer's last view of pop_count
+   __CIRCBUF_OWN_LINE circbuf_count_t pop_count;   // written by the consumer
+   __CIRCBUF_CACHED(push_cache)        // consumer's last view of push_count
+   __CIRCBUF_OWN_LINE int size;
    int element_size;
+#ifdef CIRCBUF_ENABLE_STATS
+   circbuf_stats_t stats;
+#endif
+#ifdef CIRCBUF_ENABLE_NOTIFY
+   int watermark;          // 0 = no watermark event
+   int events;             // latched CIRCBUF_EVT_* bits
+#endif
 } circbuf_t;
 
+#ifdef CIRCBUF_ENABLE_STATS
+#define __CIRCBUF_STATS_INIT      , { 0, 0, 0, 0, 0, 0, 0, 0 }
+#define __CIRCBUF_STATS_FLUSH(buf)                                    \
+   if (buf.stats.full) {                                              \
+      CIRCBUF_LOCK();                                                 \
+      buf.stats.time_full += CIRCBUF_STATS_CLOCK() - buf.stats.full_since; \
+      buf.stats.full = 0;                                             \
+      CIRCBUF_UNLOCK();                                               \
+   }
+#else
+#define __CIRCBUF_STATS_INIT
+#define __CIRCBUF_STATS_FLUSH(buf)
+#endif
+
+#ifdef CIRCBUF_ENABLE_NOTIFY
+#define __CIRCBUF_NOTIFY_INIT     , 0, 0
+#else
+#define __CIRCBUF_NOTIFY_INIT
+#endif
+
+// Adds 0 to the storage size, or stops the build on a size the counters can't
+// handle: without CIRCBUF_WIDE they run up to 2 * size in an int16_t, with a
+// 32 bit size_t the wide ones need a power of two
+// (same trick as BUILD_ASSERT_OR_ZERO in util.h)
+#ifdef CIRCBUF_WIDE
+#define __CIRCBUF_CHECK_SIZE(sz)  \
+   (sizeof(char [1 - 2*!((sz) > 0 && (sizeof(size_t) > 4 || ((sz) & ((sz) - 1)) == 0))]) - 1)
+#else
+#define __CIRCBUF_CHECK_SIZE(sz)  (sizeof(char [1 - 2*!((sz) > 0 && (sz) <= 16383)]) - 1)
+#endif
+
 #define __CIRCBUF_VAR_DEF(type, buf, sz)  \
-   type buf ## _circbuf_data[sz];         \
+   type buf ## _circbuf_data[(sz) + __CIRCBUF_CHECK_SIZE(sz)]; \
    circbuf_t buf= {              \
       buf ## _circbuf_data,      \
       0,                         \
+      __CIRCBUF_CACHE_INIT       \
       0,                         \
+      __CIRCBUF_CACHE_INIT       \
       sz,                        \
       sizeof(type)               \
+      __CIRCBUF_STATS_INIT       \
+      __CIRCBUF_NOTIFY_INIT      \
    };
 
 //!#define __CIRCBUF_VAR_DEF(type, buf, sz)      \
@@ -42,8 +210,42 @@ typedef struct {
 int __circbuf_push(circbuf_t *circbuf, void *elem);
 int __circbuf_pop (circbuf_t *circbuf, void *elem, int read_only);
 int __circbuf_free_space(circbuf_t *circbuf);
+int __circbuf_push_overwrite(circbuf_t *circbuf, void *elem);
+typedef struct {
+   void * buffer;
+   uint16_t head;          // push count, wraps at `wrap`
+   uint16_t * tails;       // pop count, one per reader, wraps at `wrap`
+   uint16_t wrap;          // multiple of size, so slots stay put at the wrap
+   int readers;
+   int size;
+   int element_size;
+   int overwrite;
+} circbuf_bcast_t;
+
+int __circbuf_bcast_push(circbuf_bcast_t *circbuf, void *elem);
+int __circbuf_bcast_pop(circbuf_bcast_t *circbuf, int reader, void *elem);
+int __circbuf_bcast_count(circbuf_bcast_t *circbuf, int reader);
+void __circbuf_stats(circbuf_t *circbuf, circbuf_stats_t *stats);
+void __circbuf_stats_reset(circbuf_t *circbuf);
+int __circbuf_events_take(circbuf_t *circbuf);
 /* -------------------------------------------------------------------------- */
 
+/**
+ * Description:
+ *   View of the occupied slots of a circular buffer, oldest first, as at most
+ *   two runs of contiguous elements: `first` from the tail towards the end
+ *   of the storage, then `second` from the start of the storage. `second_len`
+ *   is 0 when the contents do not wrap.
+ */
+typedef struct {
+   void * first;
+   int first_len;
+   void * second;
+   int second_len;
+} circbuf_span_t;
+
+int __circbuf_spans(circbuf_t *circbuf, circbuf_span_t *spans);
+
 /**
  * Description:
  *   Zero slots in circular buffer after a pop.
@@ -83,6 +285,8 @@ int __circbuf_free_space(circbuf_t *circbuf);
    do {                  \
       buf.push_count = 0;         \
       buf.pop_count = 0;         \
+      __CIRCBUF_CACHE_FLUSH(buf)   \
+      __CIRCBUF_STATS_FLUSH(buf)   \
    } while(0)
 
 /**
@@ -96,6 +300,17 @@ int __circbuf_free_space(circbuf_t *circbuf);
  */
 #define CIRCBUF_PUSH(buf, elem)             buf ## _push_refd(elem)
 
+/**
+ * Description:
+ *   Same as CIRCBUF_PUSH but never fails: when `buf` is full the element at
+ *   the tail is dropped to make room. For logs where the newest entries
+ *   matter most.
+ *
+ * Returns (int):
+ *   0 - Success
+ */
+#define CIRCBUF_PUSH_OVERWRITE(buf, elem)   __circbuf_push_overwrite(&buf, elem)
+
 /**
  * Description:
  *   Copies the element at tail of circular buffer `buf` into location pointed
@@ -128,4 +343,149 @@ int __circbuf_free_space(circbuf_t *circbuf);
  */
 #define CIRCBUF_FS(buf)                     __circbuf_free_space(&buf)
 
+/**
+ * Description:
+ *   Copies the statistics of circular buffer `buf` into the circbuf_stats_t
+ *   pointed to by `stats`. Time at full includes the current stretch if the
+ *   buffer is full right now. Needs CIRCBUF_ENABLE_STATS.
+ */
+#define CIRCBUF_STATS_GET(buf, stats)       __circbuf_stats(&buf, stats)
+
+/**
+ * Description:
+ *   Zeroes the statistics of circular buffer `buf`. Peak occupancy restarts
+ *   from the current occupancy. Needs CIRCBUF_ENABLE_STATS.
+ */
+#define CIRCBUF_STATS_RESET(buf)            __circbuf_stats_reset(&buf)
+
+/**
+ * Description:
+ *   Sets the occupancy at which a push raises CIRCBUF_EVT_WATERMARK on `buf`,
+ *   0 to disable. Needs CIRCBUF_ENABLE_NOTIFY.
+ */
+#define CIRCBUF_SET_WATERMARK(buf, level)   buf.watermark = (level)
+
+/**
+ * Description:
+ *   Returns the events latched on `buf` since the last call and clears them.
+ *   Needs CIRCBUF_ENABLE_NOTIFY.
+ *
+ * Returns (int):
+ *   CIRCBUF_EVT_* bits, 0 if nothing happened
+ */
+#define CIRCBUF_EVENTS_TAKE(buf)            __circbuf_events_take(&buf)
+
+/**
+ * Description:
+ *   Fills the circbuf_span_t pointed to by `spans` with the elements waiting
+ *   in `buf`, in place: nothing is copied and pop_count does not move. The
+ *   elements stay valid until they are popped. Pushes made after the call
+ *   are not in the view. Not safe against CIRCBUF_PUSH_OVERWRITE from
+ *   another context, which may reuse the oldest slot.
+ *
+ * Returns (int):
+ *   0..N - number of elements in the view
+ */
+#define CIRCBUF_SPANS(buf, spans)           __circbuf_spans(&buf, spans)
+
+/**
+ * Description:
+ *   Loops `p`, a `type` pointer, over every element of circbuf_span_t
+ *   `spans`, oldest first, without a call per element. A `break` only leaves
+ *   the current span.
+ *
+ * Usage:
+ *   CIRCBUF_SPANS(rx_ring_buf, &spans);
+ *   CIRCBUF_FOREACH(spans, pool_handle_t, h)
+ *      dump(*h);
+ */
+#define CIRCBUF_FOREACH(spans, type, p)                                 \
+   for (int __s = 0; __s < 2; __s++)                                    \
+      for (type *p = (type *)(__s ? (spans).second : (spans).first),    \
+           *__end = p + (__s ? (spans).second_len : (spans).first_len); \
+           p < __end; p++)
+
+/**
+ * Description:
+ *   Defines a global single-writer, multi-reader circular buffer `buf` of
+ *   `size` elements (at most 32767) shared by `readers` readers, numbered
+ *   0..readers-1. Every reader sees every element through its own cursor,
+ *   so one copy serves all of them.
+ *
+ *   With `overwrite` 0 the writer is held back by the slowest reader, a push
+ *   fails while any reader still has `size` elements to read. With
+ *   `overwrite` 1 the writer never blocks, a reader that falls a full lap
+ *   behind skips ahead and its next pop reports the loss. One slot is kept
+ *   free for the element being written, so it holds `size` - 1.
+ *
+ *   The cursors wrap at the largest multiple of `size` up to 32768, so any
+ *   size works, and a lapped reader is noticed as long as it is less than
+ *   that many elements behind.
+ *
+ * Usage:
+ *   CIRCBUF_BCAST_DEF(can_rx_frame_t, rx_bcast, 32, 3, 1);
+ */
+#define CIRCBUF_BCAST_DEF(type, buf, sz, nreaders, ovw)  \
+   type buf ## _circbuf_data[sz];         \
+   uint16_t buf ## _circbuf_tails[nreaders] = { 0 }; \
+   circbuf_bcast_t buf= {        \
+      buf ## _circbuf_data,      \
+      0,                         \
+      buf ## _circbuf_tails,     \
+      32768 / (sz) * (sz),       \
+      nreaders,                  \
+      sz,                        \
+      sizeof(type),              \
+      ovw                        \
+   };                            \
+   int buf ## _push_refd(type *pt)         \
+   {                  \
+      return __circbuf_bcast_push(&buf, pt);   \
+   }                  \
+   int buf ## _pop_refd(int reader, type *pt)   \
+   {                  \
+      return __circbuf_bcast_pop(&buf, reader, pt);   \
+   }
+
+/**
+ * Description:
+ *   Pushes element pointed to by `elem` into broadcast buffer `buf`.
+ *
+ * Returns (int):
+ *   0 - Success
+ *  -1 - Out of space, the slowest reader is a full buffer behind
+ *       (never with overwrite)
+ */
+#define CIRCBUF_BCAST_PUSH(buf, elem)             buf ## _push_refd(elem)
+
+/**
+ * Description:
+ *   Copies the next element for reader `reader` of broadcast buffer `buf`
+ *   into `elem` and advances that reader only.
+ *
+ * Returns (int):
+ *   0 - Success
+ *   1 - Success, but the writer lapped this reader and older elements were
+ *       lost (overwrite only)
+ *  -1 - Empty for this reader
+ */
+#define CIRCBUF_BCAST_POP(buf, reader, elem)      buf ## _pop_refd(reader, elem)
+
+/**
+ * Description:
+ *   Empties broadcast buffer `buf` for every reader.
+ */
+#define CIRCBUF_BCAST_FLUSH(buf)                  \
+   do {                                           \
+      buf.head = 0;                               \
+      for (int __i = 0; __i < buf.readers; __i++) \
+         buf.tails[__i] = 0;                      \
+   } while(0)
+
+/**
+ * Description:
+ *   Returns the number of elements reader `reader` has not read yet.
+ */
+#define CIRCBUF_BCAST_COUNT(buf, reader)          __circbuf_bcast_count(&buf, reader)
+
 #endif /* _UTIL_CIRCBUF_H_ */
@@ -0,0 +1,103 @@
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "circbuf.h"
+#include "circbuf_huge.h"
+
+// <linux/mempolicy.h> values, no libnuma needed
+#define __CIRCBUF_MPOL_PREFERRED  1
+
+static size_t __circbuf_huge_len(int size, int element_size)
+{
+   size_t len = (size_t)size * element_size;
+
+   return (len + CIRCBUF_HUGE_PAGE - 1) & ~(CIRCBUF_HUGE_PAGE - 1);
+}
+
+// Anonymous memory on a huge page boundary, so khugepaged (or the fault
+// path) can back all of it with huge pages, not just the aligned middle
+static void *__circbuf_huge_map_aligned(size_t len)
+{
+   char *map, *start;
+   size_t head;
+
+   map = mmap(NULL, len + CIRCBUF_HUGE_PAGE, PROT_READ | PROT_WRITE,
+              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+   if (map == MAP_FAILED)
+      return MAP_FAILED;
+   start = (char *)(((uintptr_t)map + CIRCBUF_HUGE_PAGE - 1) & ~(CIRCBUF_HUGE_PAGE - 1));
+   head = start - map;
+   if (head)
+      munmap(map, head);
+   munmap(start + len, CIRCBUF_HUGE_PAGE - head);
+   return start;
+}
+
+static int __circbuf_huge_bind(void *addr, size_t len, int node)
+{
+   unsigned long mask[16];
+   unsigned int cpu, cur;
+
+   if (node == CIRCBUF_HUGE_NODE_SELF) {
+      if (syscall(SYS_getcpu, &cpu, &cur, NULL) < 0)
+         return -1;
+      node = cur;
+   }
+   if (node < 0 || node >= (int)(sizeof(mask) * 8))
+      return -1;
+
+   memset(mask, 0, sizeof(mask));
+   mask[node / (8 * sizeof(long))] = 1UL << (node % (8 * sizeof(long)));
+   // Preferred, not bound: a full node spills over instead of failing
+   return syscall(SYS_mbind, addr, len, __CIRCBUF_MPOL_PREFERRED, mask,
+                  sizeof(mask) * 8, 0);
+}
+
+int __circbuf_huge_alloc(circbuf_t *circ_buf, int size, int flags, int node)
+{
+   size_t len = __circbuf_huge_len(size, circ_buf->element_size);
+   void *map = MAP_FAILED;
+   int got = 0;
+
+#ifdef MAP_HUGETLB
+   if (flags & CIRCBUF_HUGE_EXPLICIT) {
+      map = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+      if (map != MAP_FAILED)
+         got |= CIRCBUF_HUGE_EXPLICIT;
+   }
+#endif
+   if (map == MAP_FAILED) {
+      map = __circbuf_huge_map_aligned(len);
+      if (map == MAP_FAILED)
+         return -1;
+#ifdef MADV_HUGEPAGE
+      if ((flags & CIRCBUF_HUGE_THP) && madvise(map, len, MADV_HUGEPAGE) == 0)
+         got |= CIRCBUF_HUGE_THP;
+#endif
+   }
+
+   // Policy first, then fault every page in so it lands where asked
+   if ((flags & CIRCBUF_HUGE_NODE) && __circbuf_huge_bind(map, len, node) == 0)
+      got |= CIRCBUF_HUGE_NODE;
+   memset(map, 0, len);
+
+   // storage first, a push only goes through once the size is set
+   circ_buf->buffer = map;
+   circ_buf->push_count = circ_buf->pop_count = 0;
+   __CIRCBUF_CACHE_FLUSH((*circ_buf))
+   __atomic_store_n(&circ_buf->size, size, __ATOMIC_RELEASE);
+   return got;
+}
+
+void __circbuf_huge_free(circbuf_t *circ_buf)
+{
+   if (circ_buf->buffer)
+      munmap(circ_buf->buffer, __circbuf_huge_len(circ_buf->size, circ_buf->element_size));
+   circ_buf->size = 0;
+   circ_buf->push_count = circ_buf->pop_count = 0;
+   circ_buf->buffer = NULL;
+}
@@ -0,0 +1,93 @@
+#ifndef _UTIL_CIRCBUF_HUGE_H_
+#define _UTIL_CIRCBUF_HUGE_H_
+
+#include <stddef.h>
+
+#ifndef CIRCBUF_WIDE
+#error circbuf_huge.h needs CIRCBUF_WIDE, deep rings overflow the default counters
+#endif
+
+// Host only. Storage for deep circbuf_t rings (see CIRCBUF_WIDE) on huge
+// pages, placed on the NUMA node of the thread that will drain them. A ring of
+// millions of frames walks through far more 4 KB pages than the TLB holds, on
+// 2 MB pages it takes a few hundred entries. Each step falls back quietly when
+// the system cannot do it, the ring then simply ends up on normal pages or on
+// whatever node the kernel picks.
+
+/**
+ * Description:
+ *   Huge page size, the storage is rounded up to a multiple of it.
+ */
+#ifndef CIRCBUF_HUGE_PAGE
+#define CIRCBUF_HUGE_PAGE         (2UL * 1024 * 1024)
+#endif
+
+#define CIRCBUF_HUGE_EXPLICIT     0x01  // hugetlbfs pages, needs vm.nr_hugepages
+#define CIRCBUF_HUGE_THP          0x02  // transparent huge pages, madvise()
+#define CIRCBUF_HUGE_NODE         0x04  // bind to a NUMA node
+
+#define CIRCBUF_HUGE_NODE_SELF    -1    // node of the calling thread
+
+/** --- Internal methods and structures. DON'T USE --------------------------- */
+int __circbuf_huge_alloc(circbuf_t *circbuf, int size, int flags, int node);
+void __circbuf_huge_free(circbuf_t *circbuf);
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Description:
+ *   Defines a global circular buffer `buf` like CIRCBUF_DEF, but without
+ *   storage. Its size stays 0 until CIRCBUF_HUGE_ALLOC(), so until then it
+ *   refuses every push as full and every pop as empty.
+ *
+ * Usage:
+ *   CIRCBUF_HUGE_DEF(can_rx_frame_t, capture, 1 << 24);
+ *   CIRCBUF_HUGE_ALLOC(capture, CIRCBUF_HUGE_EXPLICIT | CIRCBUF_HUGE_THP |
+ *                      CIRCBUF_HUGE_NODE, CIRCBUF_HUGE_NODE_SELF);
+ */
+#define CIRCBUF_HUGE_DEF(type, buf, sz)      \
+   const int buf ## _huge_size = sz;       \
+   circbuf_t buf= {              \
+      NULL,                      \
+      0,                         \
+      __CIRCBUF_CACHE_INIT       \
+      0,                         \
+      __CIRCBUF_CACHE_INIT       \
+      0,                         \
+      sizeof(type)               \
+      __CIRCBUF_STATS_INIT       \
+      __CIRCBUF_NOTIFY_INIT      \
+   };                            \
+   int buf ## _push_refd(type *pt)         \
+   {                  \
+      return __circbuf_push(&buf, pt);   \
+   }                  \
+   int buf ## _pop_refd(type *pt)         \
+   {                  \
+      return __circbuf_pop(&buf, pt, 0);   \
+   }                  \
+   int buf ## _peek_refd(type *pt)         \
+   {                  \
+      return __circbuf_pop(&buf, pt, 1);   \
+   }
+
+/**
+ * Description:
+ *   Maps the storage of `buf`, trying the CIRCBUF_HUGE_* steps in `flags` and
+ *   binding it to NUMA node `node`, or to the node of the calling thread with
+ *   CIRCBUF_HUGE_NODE_SELF, so call it from the consumer. Every page is
+ *   faulted in before it returns, none of that cost lands on the first lap.
+ *
+ * Returns (int):
+ *   0..N - CIRCBUF_HUGE_* bits that took effect, the rest fell back
+ *  -1 - Could not map the storage at all, errno tells why
+ */
+#define CIRCBUF_HUGE_ALLOC(buf, flags, node)   \
+   __circbuf_huge_alloc(&buf, buf ## _huge_size, flags, node)
+
+/**
+ * Description:
+ *   Unmaps the storage of `buf` and empties it, its size is 0 again.
+ */
+#define CIRCBUF_HUGE_FREE(buf)                 __circbuf_huge_free(&buf)
+
+#endif /* _UTIL_CIRCBUF_HUGE_H_ */
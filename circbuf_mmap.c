@@ -0,0 +1,122 @@
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "circbuf_mmap.h"
+
+int __circbuf_mmap_open(circbuf_mmap_t *circ_buf, const char *path)
+{
+   struct stat st;
+   size_t len;
+   void *map;
+   int fd;
+
+   if (circ_buf->size == 0 || (circ_buf->size & (circ_buf->size - 1))) {
+      errno = EINVAL;
+      return -1; // the slot is push_count & (size - 1)
+   }
+   len = __CIRCBUF_MMAP_HDR_SIZE + (size_t)circ_buf->size * circ_buf->element_size;
+
+   fd = open(path, O_RDWR | O_CREAT, 0644);
+   if (fd < 0)
+      return -1;
+   if (fstat(fd, &st) < 0)
+      goto fail;
+   if (st.st_size == 0 && ftruncate(fd, len) < 0)
+      goto fail;
+   if (st.st_size != 0 && (size_t)st.st_size != len) {
+      close(fd);
+      return -2; // Another geometry
+   }
+
+   map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   if (map == MAP_FAILED)
+      goto fail;
+
+   circ_buf->hdr = map;
+   circ_buf->data = (char *)map + __CIRCBUF_MMAP_HDR_SIZE;
+   circ_buf->map_len = len;
+   circ_buf->fd = fd;
+
+   if (st.st_size == 0) {
+      // Fresh file, reads back as zeroes: counters start at 0
+      circ_buf->hdr->size = circ_buf->size;
+      circ_buf->hdr->element_size = circ_buf->element_size;
+      __atomic_thread_fence(__ATOMIC_RELEASE);
+      memcpy(circ_buf->hdr->magic, __CIRCBUF_MMAP_MAGIC, 4);
+   } else if (memcmp(circ_buf->hdr->magic, __CIRCBUF_MMAP_MAGIC, 4) ||
+              circ_buf->hdr->size != circ_buf->size ||
+              circ_buf->hdr->element_size != circ_buf->element_size) {
+      __circbuf_mmap_close(circ_buf);
+      return -2; // Another geometry
+   }
+   return 0;
+
+fail:
+   close(fd);
+   return -1;
+}
+
+void __circbuf_mmap_close(circbuf_mmap_t *circ_buf)
+{
+   if (circ_buf->hdr)
+      munmap(circ_buf->hdr, circ_buf->map_len);
+   if (circ_buf->fd >= 0)
+      close(circ_buf->fd);
+   circ_buf->hdr = NULL;
+   circ_buf->data = NULL;
+   circ_buf->fd = -1;
+}
+
+int __circbuf_mmap_push(circbuf_mmap_t *circ_buf, void *elem)
+{
+   circbuf_mmap_hdr_t *hdr = circ_buf->hdr;
+   uint32_t head, tail;
+
+   head = __atomic_load_n(&hdr->push_count, __ATOMIC_RELAXED);
+   tail = __atomic_load_n(&hdr->pop_count, __ATOMIC_ACQUIRE);
+   if (head - tail >= circ_buf->size)
+      return -1; // Full
+
+   memcpy(circ_buf->data + (size_t)(head & (circ_buf->size - 1)) * circ_buf->element_size,
+          elem, circ_buf->element_size);
+   __atomic_store_n(&hdr->push_count, head + 1, __ATOMIC_RELEASE);
+   return 0;
+}
+
+int __circbuf_mmap_pop(circbuf_mmap_t *circ_buf, void *elem, int read_only)
+{
+   circbuf_mmap_hdr_t *hdr = circ_buf->hdr;
+   uint32_t head, tail;
+   char *slot;
+
+   tail = __atomic_load_n(&hdr->pop_count, __ATOMIC_RELAXED);
+   head = __atomic_load_n(&hdr->push_count, __ATOMIC_ACQUIRE);
+   if (head == tail)
+      return -1; // Empty
+
+   slot = circ_buf->data + (size_t)(tail & (circ_buf->size - 1)) * circ_buf->element_size;
+   if (elem)
+      memcpy(elem, slot, circ_buf->element_size);
+
+   if (!read_only)
+      __atomic_store_n(&hdr->pop_count, tail + 1, __ATOMIC_RELEASE);
+   return 0;
+}
+
+int __circbuf_mmap_sync(circbuf_mmap_t *circ_buf)
+{
+   return msync(circ_buf->hdr, circ_buf->map_len, MS_ASYNC) ? -1 : 0;
+}
+
+void __circbuf_mmap_flush(circbuf_mmap_t *circ_buf)
+{
+   circbuf_mmap_hdr_t *hdr = circ_buf->hdr;
+
+   __atomic_store_n(&hdr->pop_count, __atomic_load_n(&hdr->push_count, __ATOMIC_ACQUIRE),
+                    __ATOMIC_RELEASE);
+}
@@ -0,0 +1,125 @@
+#ifndef _UTIL_CIRCBUF_MMAP_H_
+#define _UTIL_CIRCBUF_MMAP_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Host only. A circbuf whose slots and push/pop counters live in a memory
+// mapped file, so a capture survives the process crashing and another process
+// can map the same file and pop from it while it is written. One producer and
+// one consumer, possibly in different processes, no locks and no syscalls per
+// element.
+
+/** --- Internal methods and structures. DON'T USE --------------------------- */
+#define __CIRCBUF_MMAP_MAGIC      "CBUF"
+#define __CIRCBUF_MMAP_HDR_SIZE   64    // slots start on their own cache line
+
+typedef struct {
+   char magic[4];
+   uint32_t size;
+   uint32_t element_size;
+   uint32_t push_count;    // free running, written by the producer only
+   uint32_t pop_count;     // free running, written by the consumer only
+} circbuf_mmap_hdr_t;
+
+typedef struct {
+   circbuf_mmap_hdr_t * hdr;
+   char * data;
+   uint32_t size;
+   uint32_t element_size;
+   size_t map_len;
+   int fd;
+} circbuf_mmap_t;
+
+int __circbuf_mmap_open(circbuf_mmap_t *circbuf, const char *path);
+void __circbuf_mmap_close(circbuf_mmap_t *circbuf);
+int __circbuf_mmap_push(circbuf_mmap_t *circbuf, void *elem);
+int __circbuf_mmap_pop(circbuf_mmap_t *circbuf, void *elem, int read_only);
+int __circbuf_mmap_sync(circbuf_mmap_t *circbuf);
+void __circbuf_mmap_flush(circbuf_mmap_t *circbuf);
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Description:
+ *   Defines a global file backed circular buffer `buf` of a given type and
+ *   size, a power of two up to 2^31 so the free running counters keep
+ *   picking the right slot when they wrap. CIRCBUF_PUSH, CIRCBUF_POP and
+ *   CIRCBUF_PEEK work on it as on CIRCBUF_DEF, the rest of the circbuf.h
+ *   macros look inside circbuf_t and don't: use CIRCBUF_MMAP_COUNT,
+ *   CIRCBUF_MMAP_FS and CIRCBUF_MMAP_FLUSH. It holds no storage until
+ *   CIRCBUF_MMAP_OPEN().
+ *
+ * Usage:
+ *   CIRCBUF_MMAP_DEF(can_rx_frame_t, capture, 1 << 20);
+ *   CIRCBUF_MMAP_OPEN(capture, "/var/log/can/capture.ring");
+ *   CIRCBUF_PUSH(capture, &frame);
+ */
+#define CIRCBUF_MMAP_DEF(type, buf, sz)      \
+   _Static_assert((sz) > 0 && ((sz) & ((sz) - 1)) == 0 && (sz) <= 0x80000000u, \
+                  #buf ": size must be a power of two"); \
+   circbuf_mmap_t buf = { NULL, NULL, sz, sizeof(type), 0, -1 }; \
+   int buf ## _push_refd(type *pt)         \
+   {                  \
+      return __circbuf_mmap_push(&buf, pt);   \
+   }                  \
+   int buf ## _pop_refd(type *pt)         \
+   {                  \
+      return __circbuf_mmap_pop(&buf, pt, 0);   \
+   }                  \
+   int buf ## _peek_refd(type *pt)         \
+   {                  \
+      return __circbuf_mmap_pop(&buf, pt, 1);   \
+   }
+
+/**
+ * Description:
+ *   Maps file `path` as the storage of `buf`, creating it when missing. An
+ *   existing file of the same geometry is reopened with its contents and
+ *   counters, so a consumer can pick up where a crashed producer stopped.
+ *
+ * Returns (int):
+ *   0 - Success
+ *  -1 - Could not create or map the file, errno tells why
+ *  -2 - The file holds a buffer of another type or size
+ */
+#define CIRCBUF_MMAP_OPEN(buf, path)        __circbuf_mmap_open(&buf, path)
+
+/**
+ * Description:
+ *   Unmaps `buf`. The file and everything in it stays.
+ */
+#define CIRCBUF_MMAP_CLOSE(buf)             __circbuf_mmap_close(&buf)
+
+/**
+ * Description:
+ *   Starts writing dirty pages back to the file. Not needed to survive a
+ *   process crash, only a power loss.
+ *
+ * Returns (int):
+ *   0 - Success
+ *  -1 - msync() failed
+ */
+#define CIRCBUF_MMAP_SYNC(buf)              __circbuf_mmap_sync(&buf)
+
+/**
+ * Description:
+ *   Number of elements waiting in `buf`.
+ */
+#define CIRCBUF_MMAP_COUNT(buf)             \
+   ((int)(__atomic_load_n(&(buf).hdr->push_count, __ATOMIC_ACQUIRE) - \
+          __atomic_load_n(&(buf).hdr->pop_count, __ATOMIC_ACQUIRE)))
+
+/**
+ * Description:
+ *   Free slots in `buf`, like CIRCBUF_FS.
+ */
+#define CIRCBUF_MMAP_FS(buf)                ((int)((buf).size - CIRCBUF_MMAP_COUNT(buf)))
+
+/**
+ * Description:
+ *   Drops everything waiting in `buf`, like CIRCBUF_FLUSH. Moves the pop
+ *   counter, so only the consumer may call it.
+ */
+#define CIRCBUF_MMAP_FLUSH(buf)             __circbuf_mmap_flush(&buf)
+
+#endif /* _UTIL_CIRCBUF_MMAP_H_ */
@@ -0,0 +1,317 @@
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "circbuf_shm.h"
+
+#define __CIRCBUF_SHM_MAGIC   "CBSH"
+#define CIRCBUF_SHM_REAP_MS   100   // dead reader check while a writer waits
+
+// Shared between processes, so no FUTEX_PRIVATE_FLAG
+static int circbuf_shm_futex_wait(uint32_t *addr, uint32_t val, int timeout_ms)
+{
+   struct timespec ts, *pts = NULL;
+
+   if (timeout_ms >= 0) {
+      ts.tv_sec = timeout_ms / 1000;
+      ts.tv_nsec = (long)(timeout_ms % 1000) * 1000000;
+      pts = &ts;
+   }
+   return syscall(SYS_futex, addr, FUTEX_WAIT, val, pts, NULL, 0);
+}
+
+static void circbuf_shm_futex_wake(uint32_t *addr)
+{
+   syscall(SYS_futex, addr, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+// Frees reader slot `i` when the process holding it no longer exists. Returns
+// 1 when the slot is free afterwards.
+static int circbuf_shm_reap(__circbuf_shm_hdr_t *hdr, uint32_t i)
+{
+   __circbuf_shm_reader_t *r = &hdr->reader[i];
+   uint32_t held = 1;
+   int32_t pid = __atomic_load_n(&r->pid, __ATOMIC_RELAXED);
+
+   // pid 0: attach() is between claiming the slot and recording itself
+   if (pid <= 0 || kill(pid, 0) == 0 || errno != ESRCH)
+      return !__atomic_load_n(&r->attached, __ATOMIC_RELAXED);
+   // only the reaper that takes the dead pid frees the slot, another one that
+   // saw the same pid could otherwise free it again under a new reader
+   if (!__atomic_compare_exchange_n(&r->pid, &pid, 0, 0,
+                                    __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+      return !__atomic_load_n(&r->attached, __ATOMIC_RELAXED);
+   __atomic_compare_exchange_n(&r->attached, &held, 0, 0,
+                               __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+   return 1;
+}
+
+static int circbuf_shm_map(circbuf_shm_t *cb, int fd, size_t len)
+{
+   void *map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+   close(fd);
+   if (map == MAP_FAILED)
+      return -1;
+   cb->hdr = map;
+   cb->data = (char *)map + sizeof(__circbuf_shm_hdr_t);
+   cb->map_len = len;
+   cb->cached_head = 0;
+   cb->cached_tail = 0;
+   return 0;
+}
+
+int circbuf_shm_create(circbuf_shm_t *cb, const char *name, uint32_t size,
+                       uint32_t element_size, uint32_t readers, int overwrite)
+{
+   size_t len = sizeof(__circbuf_shm_hdr_t) + (size_t)size * element_size;
+   int fd;
+
+   if (size == 0 || size > 0x80000000u || (size & (size - 1)) || readers == 0 ||
+       readers > CIRCBUF_SHM_MAX_READERS) {
+      errno = EINVAL;
+      return -1;
+   }
+
+   shm_unlink(name);  // stale ring from an earlier run
+   fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+   if (fd < 0)
+      return -1;
+   if (ftruncate(fd, len) < 0) {
+      close(fd);
+      return -1;
+   }
+   if (circbuf_shm_map(cb, fd, len))
+      return -1;
+
+   // New shared memory reads back as zeroes: counters start at 0
+   cb->hdr->size = size;
+   cb->hdr->element_size = element_size;
+   cb->hdr->readers = readers;
+   cb->hdr->overwrite = overwrite ? 1 : 0;
+   __atomic_thread_fence(__ATOMIC_RELEASE);
+   memcpy(cb->hdr->magic, __CIRCBUF_SHM_MAGIC, 4);
+   return 0;
+}
+
+int circbuf_shm_attach(circbuf_shm_t *cb, const char *name)
+{
+   __circbuf_shm_hdr_t *hdr;
+   struct stat st;
+   int fd;
+
+   fd = shm_open(name, O_RDWR, 0);
+   if (fd < 0)
+      return -1;
+   if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(__circbuf_shm_hdr_t)) {
+      close(fd);
+      errno = EINVAL;
+      return -2; // Not a ring
+   }
+   if (circbuf_shm_map(cb, fd, st.st_size))
+      return -1;
+   hdr = cb->hdr;
+   __atomic_thread_fence(__ATOMIC_ACQUIRE);
+   if (memcmp(hdr->magic, __CIRCBUF_SHM_MAGIC, 4) ||
+       hdr->size == 0 || (hdr->size & (hdr->size - 1)) ||
+       hdr->readers > CIRCBUF_SHM_MAX_READERS ||
+       sizeof(__circbuf_shm_hdr_t) + (size_t)hdr->size * hdr->element_size
+          != (size_t)st.st_size) {
+      circbuf_shm_close(cb, -1);
+      return -2; // Not a ring
+   }
+
+   for (uint32_t i = 0; i < hdr->readers; i++) {
+      uint32_t free_slot = 0;
+      __circbuf_shm_reader_t *r = &hdr->reader[i];
+
+      if (__atomic_load_n(&r->attached, __ATOMIC_RELAXED) &&
+          !circbuf_shm_reap(hdr, i))
+         continue;
+      // Until the tail below lands the writer may see the last owner's one
+      // and briefly report full, never the other way round
+      if (__atomic_compare_exchange_n(&r->attached, &free_slot, 1, 0,
+                                      __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+         __atomic_store_n(&r->pid, getpid(), __ATOMIC_RELAXED);
+         __atomic_store_n(&r->tail, __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE),
+                          __ATOMIC_SEQ_CST);
+         cb->cached_head = r->tail;
+         return i;
+      }
+   }
+   circbuf_shm_close(cb, -1);
+   return -2; // No reader slot left
+}
+
+void circbuf_shm_close(circbuf_shm_t *cb, int reader)
+{
+   if (!cb->hdr)
+      return;
+   if (reader >= 0) {
+      __atomic_store_n(&cb->hdr->reader[reader].pid, 0, __ATOMIC_RELAXED);
+      __atomic_store_n(&cb->hdr->reader[reader].attached, 0, __ATOMIC_SEQ_CST);
+      if (__atomic_load_n(&cb->hdr->writer_waiting, __ATOMIC_SEQ_CST))
+         circbuf_shm_futex_wake(&cb->hdr->reader[reader].tail);
+   }
+   munmap(cb->hdr, cb->map_len);
+   cb->hdr = NULL;
+   cb->data = NULL;
+}
+
+int circbuf_shm_unlink(const char *name)
+{
+   return shm_unlink(name);
+}
+
+// Slowest attached reader, -1 when none is attached
+static int circbuf_shm_slowest(__circbuf_shm_hdr_t *hdr, uint32_t head, uint32_t *tail)
+{
+   uint32_t most = 0;
+   int slowest = -1;
+
+   for (uint32_t i = 0; i < hdr->readers; i++) {
+      __circbuf_shm_reader_t *r = &hdr->reader[i];
+      uint32_t t;
+
+      if (!__atomic_load_n(&r->attached, __ATOMIC_ACQUIRE))
+         continue;
+      t = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+      if (slowest < 0 || head - t > most) {
+         most = head - t;
+         slowest = i;
+         *tail = t;
+      }
+   }
+   return slowest;
+}
+
+int circbuf_shm_push(circbuf_shm_t *cb, void *elem)
+{
+   __circbuf_shm_hdr_t *hdr = cb->hdr;
+   uint32_t head = hdr->head;  // only we write it
+
+   if (!hdr->overwrite && head - cb->cached_tail >= hdr->size) {
+      // Looks full from the cached tail, find out how far readers really are
+      int slowest = circbuf_shm_slowest(hdr, head, &cb->cached_tail);
+
+      // a reader that died attached would hold us back forever
+      if (slowest >= 0 && head - cb->cached_tail >= hdr->size &&
+          circbuf_shm_reap(hdr, slowest))
+         slowest = circbuf_shm_slowest(hdr, head, &cb->cached_tail);
+      if (slowest < 0)
+         cb->cached_tail = head;
+      if (head - cb->cached_tail >= hdr->size)
+         return -1; // Full
+   }
+
+   // Seqlock order for lapped readers: the previous head store must be seen
+   // before any of the data overwriting slot head, else a reader checking
+   // head after its copy takes a torn element for a stable one
+   if (hdr->overwrite)
+      __atomic_thread_fence(__ATOMIC_RELEASE);
+   memcpy(cb->data + (size_t)(head & (hdr->size - 1)) * hdr->element_size, elem,
+          hdr->element_size);
+   __atomic_store_n(&hdr->head, head + 1, __ATOMIC_SEQ_CST);
+
+   if (__atomic_load_n(&hdr->reader_waiting, __ATOMIC_SEQ_CST))
+      circbuf_shm_futex_wake(&hdr->head);
+   return 0;
+}
+
+int circbuf_shm_pop(circbuf_shm_t *cb, int reader, void *elem)
+{
+   __circbuf_shm_hdr_t *hdr = cb->hdr;
+   __circbuf_shm_reader_t *r = &hdr->reader[reader];
+   uint32_t tail = r->tail;  // only this reader writes it
+   int lapped = 0;
+
+   for (;;) {
+      if (cb->cached_head == tail) {
+         cb->cached_head = __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE);
+         if (cb->cached_head == tail)
+            return -1; // Empty
+      }
+
+      // With overwrite only head-size+1 .. head-1 are stable, the writer may
+      // be busy with slot head
+      if (hdr->overwrite && cb->cached_head - tail >= hdr->size) {
+         cb->cached_head = __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE);
+         tail = cb->cached_head - hdr->size + 1;
+         lapped = 1;
+      }
+
+      memcpy(elem, cb->data + (size_t)(tail & (hdr->size - 1)) * hdr->element_size,
+             hdr->element_size);
+      if (!hdr->overwrite)
+         break;
+
+      // Lapped while copying, the element may be torn: try again
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      cb->cached_head = __atomic_load_n(&hdr->head, __ATOMIC_RELAXED);
+      if (cb->cached_head - tail < hdr->size)
+         break;
+   }
+
+   __atomic_store_n(&r->tail, tail + 1, __ATOMIC_SEQ_CST);
+   if (__atomic_load_n(&hdr->writer_waiting, __ATOMIC_SEQ_CST))
+      circbuf_shm_futex_wake(&r->tail);
+   return lapped;
+}
+
+int circbuf_shm_push_wait(circbuf_shm_t *cb, void *elem, int timeout_ms)
+{
+   __circbuf_shm_hdr_t *hdr = cb->hdr;
+   uint32_t tail;
+   int slowest, slice;
+
+   while (circbuf_shm_push(cb, elem)) {
+      // Wake up now and then even when waiting forever, the reader we wait
+      // for may have died and only a push attempt reaps it
+      slice = timeout_ms < 0 || timeout_ms > CIRCBUF_SHM_REAP_MS ?
+              CIRCBUF_SHM_REAP_MS : timeout_ms;
+      __atomic_store_n(&hdr->writer_waiting, 1, __ATOMIC_SEQ_CST);
+      slowest = circbuf_shm_slowest(hdr, hdr->head, &tail);
+      // Re-check after raising the flag, a pop in between would not wake us
+      if (slowest >= 0 && hdr->head - tail >= hdr->size &&
+          circbuf_shm_futex_wait(&hdr->reader[slowest].tail, tail, slice) &&
+          errno == ETIMEDOUT && timeout_ms >= 0) {
+         timeout_ms -= slice;
+         if (timeout_ms <= 0) {
+            __atomic_store_n(&hdr->writer_waiting, 0, __ATOMIC_SEQ_CST);
+            return -1;
+         }
+      }
+      __atomic_store_n(&hdr->writer_waiting, 0, __ATOMIC_SEQ_CST);
+   }
+   return 0;
+}
+
+int circbuf_shm_pop_wait(circbuf_shm_t *cb, int reader, void *elem, int timeout_ms)
+{
+   __circbuf_shm_hdr_t *hdr = cb->hdr;
+   uint32_t tail;
+   int ret;
+
+   while ((ret = circbuf_shm_pop(cb, reader, elem)) < 0) {
+      tail = hdr->reader[reader].tail;
+      __atomic_add_fetch(&hdr->reader_waiting, 1, __ATOMIC_SEQ_CST);
+      // Re-check after registering, a push in between would not wake us
+      if (__atomic_load_n(&hdr->head, __ATOMIC_SEQ_CST) == tail &&
+          circbuf_shm_futex_wait(&hdr->head, tail, timeout_ms) &&
+          errno == ETIMEDOUT) {
+         __atomic_sub_fetch(&hdr->reader_waiting, 1, __ATOMIC_SEQ_CST);
+         return -1;
+      }
+      __atomic_sub_fetch(&hdr->reader_waiting, 1, __ATOMIC_SEQ_CST);
+   }
+   return ret;
+}
@@ -0,0 +1,126 @@
+#ifndef _UTIL_CIRCBUF_SHM_H_
+#define _UTIL_CIRCBUF_SHM_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Host only. Single-writer ring in POSIX shared memory, read by up to
+// CIRCBUF_SHM_MAX_READERS processes, each through its own cursor, with the
+// same semantics as CIRCBUF_BCAST_DEF: one copy of every element, the writer
+// either held back by the slowest reader or lapping slow readers. With one
+// reader it is a plain SPSC ring.
+//
+// Push and pop are lock free and make no syscall. The write index and every
+// read index sit on cache lines of their own. Blocking waits park on the
+// write index with a futex, and a push only calls into the kernel when
+// somebody is parked.
+//
+// Every reader slot records the PID that holds it. A reader that died without
+// circbuf_shm_close() would stall a blocking writer for good, so once the ring
+// looks full the writer checks the PID of the slowest reader and frees the
+// slot if the process is gone. attach() reclaims such slots as well. All
+// processes must share a PID namespace.
+
+#define CIRCBUF_SHM_MAX_READERS   8
+#define CIRCBUF_SHM_LINE          64
+
+/** --- Internal methods and structures. DON'T USE --------------------------- */
+typedef struct {
+   uint32_t tail;             // free running pop count
+   uint32_t attached;
+   int32_t pid;               // owner, to detect a reader that died attached
+   char pad[CIRCBUF_SHM_LINE - 12];
+} __circbuf_shm_reader_t;
+
+typedef struct {
+   // read-mostly
+   char magic[4];
+   uint32_t size;
+   uint32_t element_size;
+   uint32_t readers;
+   uint32_t overwrite;
+   uint32_t writer_waiting;   // writer parked on a full ring
+   char pad0[CIRCBUF_SHM_LINE - 24];
+   // written by the producer
+   uint32_t head;             // free running push count, also the futex word
+   uint32_t reader_waiting;   // readers parked on head
+   char pad1[CIRCBUF_SHM_LINE - 8];
+   // written by the consumers, one line each
+   __circbuf_shm_reader_t reader[CIRCBUF_SHM_MAX_READERS];
+} __circbuf_shm_hdr_t;
+/* -------------------------------------------------------------------------- */
+
+typedef struct {
+   __circbuf_shm_hdr_t * hdr;
+   char * data;
+   size_t map_len;
+   uint32_t cached_head;      // consumer's last view of hdr->head
+   uint32_t cached_tail;      // producer's last view of the slowest tail
+} circbuf_shm_t;
+
+/**
+ * Description:
+ *   Creates (or replaces) shared memory ring `name` of `size` elements of
+ *   `element_size` bytes, for up to `readers` readers, and maps it as the
+ *   writer. `size` must be a power of two so the free running counters map
+ *   onto the same slot across their wrap. With `overwrite` set the writer
+ *   never blocks and slow readers lose data, otherwise a push fails while the
+ *   slowest reader is a ring behind.
+ *
+ * Returns (int):
+ *   0 - Success
+ *  -1 - Failed, errno tells why
+ */
+int circbuf_shm_create(circbuf_shm_t *cb, const char *name, uint32_t size,
+                       uint32_t element_size, uint32_t readers, int overwrite);
+
+/**
+ * Description:
+ *   Maps existing ring `name` and claims a free reader slot, or one whose
+ *   owner has exited, starting at the next element pushed.
+ *
+ * Returns (int):
+ *   0..N - reader number to pop with
+ *  -1 - Failed, errno tells why
+ *  -2 - Not a ring, or every reader slot is taken
+ */
+int circbuf_shm_attach(circbuf_shm_t *cb, const char *name);
+
+/**
+ * Description:
+ *   Gives back reader slot `reader` (-1 for the writer) and unmaps the ring.
+ *   The shared memory object stays until circbuf_shm_unlink().
+ */
+void circbuf_shm_close(circbuf_shm_t *cb, int reader);
+int circbuf_shm_unlink(const char *name);
+
+/**
+ * Description:
+ *   Pushes the element at `elem`.
+ *
+ * Returns (int):
+ *   0 - Success
+ *  -1 - Full, the slowest reader is a ring behind (never with overwrite)
+ */
+int circbuf_shm_push(circbuf_shm_t *cb, void *elem);
+
+/**
+ * Description:
+ *   Copies the next element for reader `reader` into `elem`.
+ *
+ * Returns (int):
+ *   0 - Success
+ *   1 - Success, but the writer lapped this reader and elements were lost
+ *  -1 - Empty
+ */
+int circbuf_shm_pop(circbuf_shm_t *cb, int reader, void *elem);
+
+/**
+ * Description:
+ *   As circbuf_shm_push() / circbuf_shm_pop(), sleeping up to `timeout_ms`
+ *   (-1 forever) for room or for an element.
+ */
+int circbuf_shm_push_wait(circbuf_shm_t *cb, void *elem, int timeout_ms);
+int circbuf_shm_pop_wait(circbuf_shm_t *cb, int reader, void *elem, int timeout_ms);
+
+#endif /* _UTIL_CIRCBUF_SHM_H_ */
@@ -0,0 +1,150 @@
+#include <stdint.h>
+
+#include "cyclic.h"
+
+typedef struct
+{
+   uint32_t id;
+   uint16_t period;        // 0 = unused entry
+   uint16_t rounds;        // wheel turns left before due
+   uint8_t * data;
+   uint8_t length;
+   uint8_t slot;
+   uint8_t next;           // next entry in the same slot
+} cyc_entry_t;
+
+cyc_entry_t cyc_table[CYC_MAX_ENTRIES];
+uint8_t cyc_wheel[CYC_WHEEL_SLOTS];       // first entry of each slot
+uint8_t cyc_load[CYC_WHEEL_SLOTS];        // entries per slot, for auto phase
+uint8_t cyc_pos;                          // slot processed by the last tick
+uint32_t cyc_missed;                      // due frames the TX ring refused
+
+void cyc_init()
+{
+   for ( uint8_t i = 0 ; i < CYC_MAX_ENTRIES ; i++ )
+      cyc_table[i].period = 0;
+   for ( uint8_t i = 0 ; i < CYC_WHEEL_SLOTS ; i++ )
+   {
+      cyc_wheel[i] = CYC_NONE;
+      cyc_load[i] = 0;
+   }
+   cyc_pos = 0;
+   cyc_missed = 0;
+}
+
+// Schedules `entry` `delay` (>= 1) ticks after the current one
+static void cyc_insert(uint8_t entry, uint16_t delay)
+{
+   cyc_entry_t *e = &cyc_table[entry];
+
+   e->slot = (cyc_pos + delay) % CYC_WHEEL_SLOTS;
+   e->rounds = (delay - 1) / CYC_WHEEL_SLOTS;
+   e->next = cyc_wheel[e->slot];
+   cyc_wheel[e->slot] = entry;
+   cyc_load[e->slot]++;
+}
+
+static void cyc_unlink(uint8_t entry)
+{
+   uint8_t *link = &cyc_wheel[cyc_table[entry].slot];
+
+   while (*link != CYC_NONE)
+   {
+      if (*link == entry)
+      {
+         *link = cyc_table[entry].next;
+         cyc_load[cyc_table[entry].slot]--;
+         return;
+      }
+      link = &cyc_table[*link].next;
+   }
+}
+
+int16_t cyc_add(uint32_t id, uint16_t period, uint16_t phase, uint8_t *data,
+                uint8_t length)
+{
+   uint8_t entry;
+   uint16_t span;
+
+   if (period == 0 || length > 8)
+      return -1;
+
+   for ( entry = 0 ; entry < CYC_MAX_ENTRIES ; entry++ )
+   {
+      if (cyc_table[entry].period == 0)
+         break;
+   }
+   if (entry == CYC_MAX_ENTRIES)
+      return -1; // Full
+
+   if (phase == CYC_AUTO_PHASE)
+   {
+      span = period < CYC_WHEEL_SLOTS ? period : CYC_WHEEL_SLOTS;
+      phase = 0;
+      for ( uint16_t p = 1 ; p < span ; p++ )
+      {
+         if (cyc_load[(cyc_pos + p + 1) % CYC_WHEEL_SLOTS] <
+             cyc_load[(cyc_pos + phase + 1) % CYC_WHEEL_SLOTS])
+            phase = p;
+      }
+   }
+
+   cyc_table[entry].id = id;
+   cyc_table[entry].period = period;
+   cyc_table[entry].data = data;
+   cyc_table[entry].length = length;
+   cyc_insert(entry, phase % period + 1);
+   return entry;
+}
+
+void cyc_remove(uint8_t entry)
+{
+   if (entry >= CYC_MAX_ENTRIES || cyc_table[entry].period == 0)
+      return;
+   cyc_unlink(entry);
+   cyc_table[entry].period = 0;
+}
+
+int16_t cyc_tick()
+{
+   uint8_t *link;
+   uint8_t entry;
+   uint8_t due = CYC_NONE;
+   int16_t sent = 0;
+   cyc_entry_t *e;
+
+   cyc_pos = (cyc_pos + 1) % CYC_WHEEL_SLOTS;
+
+   // Take the due entries out of the slot first, a period that is a multiple
+   // of the wheel size puts them straight back into this same slot
+   link = &cyc_wheel[cyc_pos];
+   while (*link != CYC_NONE)
+   {
+      entry = *link;
+      e = &cyc_table[entry];
+      if (e->rounds)
+      {
+         e->rounds--;
+         link = &e->next;
+         continue;
+      }
+      *link = e->next;
+      cyc_load[cyc_pos]--;
+      e->next = due;
+      due = entry;
+   }
+
+   while (due != CYC_NONE)
+   {
+      entry = due;
+      e = &cyc_table[entry];
+      due = e->next;
+
+      if (can_pack_id(e->id, e->data, e->length))
+         cyc_missed++;
+      else
+         sent++;
+      cyc_insert(entry, e->period);
+   }
+   return sent;
+}
@@ -0,0 +1,70 @@
+#ifndef _CYCLIC_H_
+#define _CYCLIC_H_
+
+#include <stdint.h>
+
+// Time-triggered cyclic transmit table. Entries sit in a hashed timing wheel
+// so each tick only walks the slot that is due, and due frames are queued
+// into tx_ring_buf with can_pack_id(). Call cyc_tick() once per tick (1 ms)
+// from an RTOS task or the main loop, never from a timer ISR: can_pack_id()
+// takes the pool lock and pushes to tx_ring_buf like any other main context
+// producer. can_tx() drains the ring.
+
+/**
+ * Description:
+ *   Maximum number of cyclic frames.
+ */
+#ifndef CYC_MAX_ENTRIES
+#define CYC_MAX_ENTRIES       16
+#endif
+
+/**
+ * Description:
+ *   Number of wheel slots, in ticks. Periods up to this long cost nothing
+ *   extra, longer ones are skipped over once per wheel turn.
+ */
+#ifndef CYC_WHEEL_SLOTS
+#define CYC_WHEEL_SLOTS       64
+#endif
+
+#define CYC_NONE              0xFF  // no entry / end of a slot list
+#define CYC_AUTO_PHASE        0xFFFF
+
+/**
+ * Description:
+ *   Clears the table.
+ */
+void cyc_init();
+
+/**
+ * Description:
+ *   Sends `length` bytes from `data` with Id `id` every `period` ticks. The
+ *   payload is read when the frame is due, so the caller just keeps `data`
+ *   up to date. The first frame goes out `phase` ticks from now; with
+ *   CYC_AUTO_PHASE the least loaded slot is picked so frames with the same
+ *   period don't go out in bursts.
+ *
+ * Returns (int16_t):
+ *   0..N - entry handle for cyc_remove()
+ *  -1 - Table full or bad arguments
+ */
+int16_t cyc_add(uint32_t id, uint16_t period, uint16_t phase, uint8_t *data,
+                uint8_t length);
+
+/**
+ * Description:
+ *   Stops sending entry `entry`.
+ */
+void cyc_remove(uint8_t entry);
+
+/**
+ * Description:
+ *   Advances the wheel by one tick and queues every frame that is due. Task
+ *   context only, not safe to call from an ISR.
+ *
+ * Returns (int16_t):
+ *   0..N - number of frames queued
+ */
+int16_t cyc_tick();
+
+#endif /* _CYCLIC_H_ */
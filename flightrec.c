@@ -0,0 +1,147 @@
+#include <string.h>
+#include <stdint.h>
+
+#include "flightrec.h"
+
+#define FR_MAGIC              0x46524543  // "FREC"
+
+typedef struct
+{
+   uint32_t magic;
+   uint16_t crc;              // over the ring geometry, see fr_crc()
+   circbuf_t ring;
+   fr_record_t records[FR_RECORDS];
+} fr_area_t;
+
+// No initializer on purpose, this has to survive a reset
+FR_NOINIT fr_area_t fr_area;
+
+static uint16_t fr_crc16(uint16_t crc, uint8_t *p, uint16_t len)
+{
+   while (len--)
+   {
+      crc ^= (uint16_t)*p++ << 8;
+      for ( uint8_t i = 0 ; i < 8 ; i++ )
+         crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+   }
+   return crc;
+}
+
+// Only the parts that never change while recording are covered, so a push
+// doesn't have to update the CRC. The counters are range checked and every
+// record carries its own checksum instead.
+static uint16_t fr_crc()
+{
+   uint16_t crc = 0xFFFF;
+
+   crc = fr_crc16(crc, (uint8_t *)&fr_area.magic, sizeof(fr_area.magic));
+   crc = fr_crc16(crc, (uint8_t *)&fr_area.ring.buffer, sizeof(fr_area.ring.buffer));
+   crc = fr_crc16(crc, (uint8_t *)&fr_area.ring.size, sizeof(fr_area.ring.size));
+   crc = fr_crc16(crc, (uint8_t *)&fr_area.ring.element_size, sizeof(fr_area.ring.element_size));
+   return crc;
+}
+
+// A byte sum, a few cycles per record in the RX ISR. A CRC over the whole
+// area would have to be redone on every push.
+static uint8_t fr_sum(fr_record_t *r)
+{
+   uint8_t *p = (uint8_t *)r;
+   uint8_t sum = 0;
+
+   for ( uint8_t i = 0 ; i < sizeof(fr_record_t) ; i++ )
+      sum += p[i];
+   return sum;
+}
+
+static void fr_seal(fr_record_t *r)
+{
+   r->check = 0;
+   r->check = 0xFF - fr_sum(r);
+}
+
+int16_t fr_boot()
+{
+   int16_t kept = -1;
+
+   if (fr_area.magic == FR_MAGIC && fr_area.crc == fr_crc() &&
+       fr_area.ring.push_count >= 0 && fr_area.ring.push_count < 2 * FR_RECORDS &&
+       fr_area.ring.pop_count >= 0 && fr_area.ring.pop_count < 2 * FR_RECORDS)
+   {
+      kept = FR_RECORDS - CIRCBUF_FS(fr_area.ring);
+      for ( int16_t i = 0 ; i < kept ; i++ )
+      {
+         if (fr_sum(&fr_area.records[(fr_area.ring.pop_count + i) % FR_RECORDS]) != 0xFF)
+         {
+            kept = -1;  // one bad record and none of it can be trusted
+            break;
+         }
+      }
+   }
+
+   if (kept < 0)
+   {
+      kept = 0;
+      memset(&fr_area, 0, sizeof(fr_area));
+      fr_area.magic = FR_MAGIC;
+      fr_area.ring.buffer = fr_area.records;
+      fr_area.ring.size = FR_RECORDS;
+      fr_area.ring.element_size = sizeof(fr_record_t);
+      fr_area.crc = fr_crc();
+   }
+
+   fr_event(FR_EVT_BOOT, kept);
+   return kept;
+}
+
+void fr_frame(can_rx_frame_t *frame)
+{
+   fr_record_t r;
+
+   r.ms = *STBoard.milliseconds;
+   r.id = frame->header.Id;
+   r.kind = FR_FRAME;
+   r.length = frame->header.Length;
+   memcpy(r.data, frame->data, 8);
+   fr_seal(&r);
+   CIRCBUF_PUSH_OVERWRITE(fr_area.ring, &r);
+}
+
+void fr_event(uint8_t kind, uint32_t arg)
+{
+   fr_record_t r;
+
+   r.ms = *STBoard.milliseconds;
+   r.id = arg;
+   r.kind = kind;
+   r.length = 0;
+   memset(r.data, 0, 8);
+   fr_seal(&r);
+   // also called from the main loop, where the RX ISR could push in between
+   CIRCBUF_LOCK();
+   CIRCBUF_PUSH_OVERWRITE(fr_area.ring, &r);
+   CIRCBUF_UNLOCK();
+}
+
+void fr_dump()
+{
+   int16_t total;
+   fr_record_t *r;
+
+   total = FR_RECORDS - CIRCBUF_FS(fr_area.ring);
+   for ( int16_t i = 0 ; i < total ; i++ )
+   {
+      r = &fr_area.records[(fr_area.ring.pop_count + i) % FR_RECORDS];
+      if (r->kind != FR_FRAME)
+      {
+         fprintf(RS232_U1, "[%8Ld]:FR: event[%u] arg[%Lu]\r\n",
+            r->ms, r->kind, r->id );
+         continue;
+      }
+      fprintf(RS232_U1, "[%8Ld]:FR: frame[%LX]:", r->ms, r->id );
+      for ( uint8_t j = 0 ; j < r->length && j < 8 ; j++ )
+      {
+         fprintf(RS232_U1, " %X", r->data[j] );
+      }
+      fprintf(RS232_U1, "\r\n" );
+   }
+}
@@ -0,0 +1,77 @@
+#ifndef _FLIGHTREC_H_
+#define _FLIGHTREC_H_
+
+#include <stdint.h>
+
+// Crash flight recorder. The last FR_RECORDS received frames and log events
+// are kept in a circbuf in RAM that startup code doesn't clear, so after a
+// die() / reset_cpu() the previous run's trace is still there. fr_boot()
+// checks the header CRC and the checksum every record carries, and keeps the
+// trace only if all of it is intact.
+
+/**
+ * Description:
+ *   Number of records kept. Recording overwrites the oldest one.
+ */
+#ifndef FR_RECORDS
+#define FR_RECORDS            32
+#endif
+
+/**
+ * Description:
+ *   Placement for the recorder state. CCS C leaves globals without an
+ *   initializer alone at startup (as long as #ZERO_RAM is not used), other
+ *   toolchains need a section their startup code skips, e.g.
+ *   __attribute__((section(".noinit"))).
+ */
+#ifndef FR_NOINIT
+#define FR_NOINIT
+#endif
+
+#define FR_FRAME              0     // a received CAN frame
+#define FR_EVT_BOOT           1     // arg = number of records kept from before
+#define FR_EVT_DIE            2     // arg = first byte of the die() message
+#define FR_EVT_BUS_OFF        3     // arg = TEC:REC
+#define FR_EVT_USER           16    // first code free for the application
+
+typedef struct
+{
+   uint32_t ms;               // *STBoard.milliseconds
+   uint32_t id;               // CAN Id, or the event argument
+   uint8_t kind;              // FR_FRAME or FR_EVT_*
+   uint8_t length;
+   uint8_t check;             // fr_record_t bytes add up to 0xFF, see fr_seal()
+   uint8_t data[8];
+} fr_record_t;
+
+/**
+ * Description:
+ *   Validates the recorder left by the previous run. An intact trace is kept
+ *   and a FR_EVT_BOOT record marks where this run starts, anything else is
+ *   wiped. Call once, before anything is recorded.
+ *
+ * Returns (int16_t):
+ *   0..N - number of records kept from the previous run
+ */
+int16_t fr_boot();
+
+/**
+ * Description:
+ *   Records a received frame. Costs one circbuf push, safe in the RX ISR.
+ */
+void fr_frame(can_rx_frame_t *frame);
+
+/**
+ * Description:
+ *   Records event `kind` with argument `arg`. Safe in an ISR and in the main
+ *   loop, it holds interrupts off around the push.
+ */
+void fr_event(uint8_t kind, uint32_t arg);
+
+/**
+ * Description:
+ *   Prints every record, oldest first, without removing them.
+ */
+void fr_dump();
+
+#endif /* _FLIGHTREC_H_ */
@@ -0,0 +1,134 @@
+#include <stdint.h>
+
+#include "gateway.h"
+#ifdef GW_IDMATCH
+#include "idmatch.h"
+#include "idmatch.c"
+#endif
+
+gw_rule_t gw_rules[GW_MAX_RULES];
+uint16_t gw_rule_count;
+gw_stats_t gw_stats;
+
+#ifdef GW_IDMATCH
+// The rules of each source bus in order, entry i of gw_idm[from] is
+// gw_rules[gw_idm_rule[from][i]]
+idm_table_t gw_idm[2];
+uint16_t gw_idm_rule[2][GW_MAX_RULES];
+#endif
+
+void gw_init()
+{
+   gw_rule_count = 0;
+   memset(&gw_stats, 0, sizeof(gw_stats));
+#ifdef GW_IDMATCH
+   idm_init(&gw_idm[GW_CAN1]);
+   idm_init(&gw_idm[GW_CAN2]);
+#endif
+}
+
+int16_t gw_add_rule(uint8_t from, uint32_t id, uint32_t mask, uint32_t new_id,
+                    uint16_t min_interval_ms)
+{
+   gw_rule_t *r;
+
+   if (from > GW_CAN2)
+      return -2; // No such bus
+   if (gw_rule_count >= GW_MAX_RULES)
+      return -1; // Full
+#ifdef GW_IDMATCH
+   int16_t slot = idm_add(&gw_idm[from], id, mask, IDM_ANY);
+
+   if (slot < 0)
+      return -1; // Full
+   gw_idm_rule[from][slot] = gw_rule_count;
+#endif
+
+   r = &gw_rules[gw_rule_count];
+   r->from = from;
+   r->id = id & mask;
+   r->mask = mask;
+   r->new_id = new_id;
+   r->min_interval_ms = min_interval_ms;
+   r->last_ms = *STBoard.milliseconds - min_interval_ms;  // first frame passes
+   r->forwarded = 0;
+   r->limited = 0;
+   return gw_rule_count++;
+}
+
+// First rule for frames from bus `from` with Id `id`, NULL when none matches
+static gw_rule_t *gw_find(uint8_t from, CAN_RX_HEADER *header)
+{
+#ifdef GW_IDMATCH
+   int16_t i = idm_match(&gw_idm[from], header->Id, header->ext);
+
+   return i < 0 ? NULL : &gw_rules[gw_idm_rule[from][i]];
+#else
+   gw_rule_t *r;
+
+   for ( uint16_t i = 0 ; i < gw_rule_count ; i++ )
+   {
+      r = &gw_rules[i];
+      if (r->from == from && (header->Id & r->mask) == r->id)
+         return r;
+   }
+   return NULL;
+#endif
+}
+
+int16_t gw_route(uint8_t from, pool_handle_t h)
+{
+   gw_rule_t *r;
+   CAN_RX_HEADER *header = &POOL_PTR(can_frame_pool, h)->rx.header;
+   uint32_t id = header->Id;
+   uint32_t now;
+   int16_t ret;
+
+   r = gw_find(from, header);
+   if (r == NULL)
+      return 1; // No route
+
+   if (r->min_interval_ms)
+   {
+      now = *STBoard.milliseconds;
+      if (now - r->last_ms < r->min_interval_ms)
+      {
+         POOL_FREE(can_frame_pool, h);
+         r->limited++;
+         gw_stats.limited++;
+         return 0;
+      }
+      r->last_ms = now;
+   }
+
+   if (r->new_id != GW_KEEP_ID)
+      id = r->new_id;
+   if (from == GW_CAN1)
+      ret = can2_forward(h, id);
+   else
+      ret = can_forward(h, id);
+
+   if (ret)
+   {
+      gw_stats.tx_full++;
+      return -1;
+   }
+   r->forwarded++;
+   gw_stats.forwarded[from]++;
+   return 0;
+}
+
+void gw_poll()
+{
+   pool_handle_t h;
+
+   while ((h = can2_rx_take()) != POOL_NONE)
+   {
+      if (gw_route(GW_CAN2, h) > 0)
+      {
+         POOL_FREE(can_frame_pool, h);  // CAN2 has no local consumer
+         gw_stats.no_route++;
+      }
+   }
+   can2_tx();
+}
@@ -0,0 +1,94 @@
+#ifndef _GATEWAY_H_
+#define _GATEWAY_H_
+
+#include <stdint.h>
+
+// CAN1 <-> CAN2 gateway. Frames are routed by a small rule table and moved
+// between the per-bus rings by handle, the payload is never copied.
+// Needs USE_CAN2_PERIPHERAL == TRUE.
+
+#define GW_CAN1               0
+#define GW_CAN2               1
+
+#define GW_KEEP_ID            0xFFFFFFFF  // forward with the received Id
+
+/**
+ * Description:
+ *   Size of the routing table. Rules are checked in the order they were added
+ *   and the first match wins.
+ */
+#ifndef GW_MAX_RULES
+#define GW_MAX_RULES          8
+#endif
+
+/**
+ * Description:
+ *   Match frames against the rules with the vectorised idmatch.h tables, one
+ *   per source bus, instead of walking gw_rules. Host builds only, on by
+ *   default with CAN_BACKEND_SOCKETCAN. GW_MAX_RULES may then go up to
+ *   IDM_MAX_RULES.
+ */
+#if defined(CAN_BACKEND_SOCKETCAN) && !defined(GW_IDMATCH)
+#define GW_IDMATCH
+#endif
+
+typedef struct
+{
+   uint8_t from;              // GW_CAN1 or GW_CAN2, bus the frame arrives on
+   uint32_t id;               // match when (frame Id & mask) == id
+   uint32_t mask;
+   uint32_t new_id;           // Id on the other bus, or GW_KEEP_ID
+   uint16_t min_interval_ms;  // rate limit, 0 = forward every frame
+   uint32_t last_ms;
+   uint32_t forwarded;
+   uint32_t limited;          // dropped by the rate limit
+} gw_rule_t;
+
+typedef struct
+{
+   uint32_t forwarded[2];     // indexed by the bus the frame arrived on
+   uint32_t limited;
+   uint32_t no_route;         // CAN2 frames without a rule, CAN1 ones stay local
+   uint32_t tx_full;          // destination ring was full
+} gw_stats_t;
+
+/**
+ * Description:
+ *   Clears the routing table and statistics.
+ */
+void gw_init();
+
+/**
+ * Description:
+ *   Adds a rule forwarding frames from bus `from` whose Id matches `id` under
+ *   `mask` to the other bus, with Id `new_id`, at most once every
+ *   `min_interval_ms`.
+ *
+ * Returns (int16_t):
+ *   0..N - index of the rule
+ *  -1 - Table full
+ *  -2 - `from` is not GW_CAN1 or GW_CAN2
+ */
+int16_t gw_add_rule(uint8_t from, uint32_t id, uint32_t mask, uint32_t new_id,
+                    uint16_t min_interval_ms);
+
+/**
+ * Description:
+ *   Routes received frame `h` that arrived on bus `from`.
+ *
+ * Returns (int16_t):
+ *   0 - Frame matched a rule, handle consumed (forwarded or rate limited)
+ *   1 - No rule matched, caller still owns the handle
+ *  -1 - Matched but the destination ring was full, handle consumed
+ */
+int16_t gw_route(uint8_t from, pool_handle_t h);
+
+/**
+ * Description:
+ *   Routes everything waiting in the CAN2 RX ring and loads the CAN2 TX
+ *   buffers. CAN1 frames are routed from can_print_rx_msg(), and go out with
+ *   can_tx().
+ */
+void gw_poll();
+
+#endif /* _GATEWAY_H_ */
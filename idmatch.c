@@ -0,0 +1,81 @@
+#include <string.h>
+#include <stdint.h>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "idmatch.h"
+
+#define IDM_EXT_BIT           0x80000000
+
+void idm_init(idm_table_t *t)
+{
+   // mask 0 with a filter bit outside it can never match
+   memset(t->mask, 0, sizeof(t->mask));
+   memset(t->filter, 0xFF, sizeof(t->filter));
+   t->count = 0;
+}
+
+int16_t idm_add(idm_table_t *t, uint32_t filter, uint32_t mask, uint8_t type)
+{
+   uint16_t i = t->count;
+
+   if (i == IDM_MAX_RULES)
+      return -1; // Table full
+
+   mask &= 0x1FFFFFFF;
+   if (type != IDM_ANY)
+      mask |= IDM_EXT_BIT;
+   if (type == IDM_EID)
+      filter |= IDM_EXT_BIT;
+
+   t->mask[i] = mask;
+   t->filter[i] = filter & mask;
+   t->count++;
+   return i;
+}
+
+int16_t idm_match_scalar(const idm_table_t *t, uint32_t id, uint8_t ext)
+{
+   uint32_t key = ext ? id | IDM_EXT_BIT : id;
+
+   for (uint16_t i = 0; i < t->count; i++)
+      if ((key & t->mask[i]) == t->filter[i])
+         return i;
+   return -1;
+}
+
+int16_t idm_match(const idm_table_t *t, uint32_t id, uint8_t ext)
+{
+   uint32_t key = ext ? id | IDM_EXT_BIT : id;
+
+#if defined(__AVX2__)
+   __m256i k = _mm256_set1_epi32((int)key);
+
+   for (uint16_t i = 0; i < t->count; i += 8) {
+      __m256i m = _mm256_load_si256((const __m256i *)&t->mask[i]);
+      __m256i f = _mm256_load_si256((const __m256i *)&t->filter[i]);
+      __m256i eq = _mm256_cmpeq_epi32(_mm256_and_si256(k, m), f);
+      int hits = _mm256_movemask_ps(_mm256_castsi256_ps(eq));
+
+      if (hits)
+         return i + __builtin_ctz(hits);
+   }
+   return -1;
+#elif defined(__SSE2__)
+   __m128i k = _mm_set1_epi32((int)key);
+
+   for (uint16_t i = 0; i < t->count; i += 4) {
+      __m128i m = _mm_load_si128((const __m128i *)&t->mask[i]);
+      __m128i f = _mm_load_si128((const __m128i *)&t->filter[i]);
+      __m128i eq = _mm_cmpeq_epi32(_mm_and_si128(k, m), f);
+      int hits = _mm_movemask_ps(_mm_castsi128_ps(eq));
+
+      if (hits)
+         return i + __builtin_ctz(hits);
+   }
+   return -1;
+#else
+   return idm_match_scalar(t, id, ext);
+#endif
+}
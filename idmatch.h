@@ -0,0 +1,71 @@
+#ifndef _IDMATCH_H_
+#define _IDMATCH_H_
+
+#include <stdint.h>
+
+// Host only. Software acceptance filtering for the Linux gateway, with the
+// semantics of the ECAN filters (can_set_mask_id / can_set_filter_id): a rule
+// matches Id x when (x & mask) == (filter & mask), optionally also requiring
+// standard or extended frames. One Id is tested against 8 rules per AVX2
+// instruction or 4 per SSE2 instruction, whichever the build targets (-mavx2,
+// SSE2 is on for every x86-64), scalar otherwise.
+
+/**
+ * Description:
+ *   Rules per table. Rounded up to a multiple of 8 internally.
+ */
+#ifndef IDM_MAX_RULES
+#define IDM_MAX_RULES         256
+#endif
+
+#define IDM_ANY               0     // standard or extended, like SID_OR_EID
+#define IDM_SID               1     // standard frames only
+#define IDM_EID               2     // extended frames only
+
+#define __IDM_SLOTS           ((IDM_MAX_RULES + 7) & ~7)
+
+typedef struct
+{
+   // Structure of arrays so a vector load picks up consecutive rules. Bit 31
+   // carries the frame type, slots past `count` never match.
+   uint32_t mask[__IDM_SLOTS] __attribute__((aligned(32)));
+   uint32_t filter[__IDM_SLOTS] __attribute__((aligned(32)));  // already masked
+   uint16_t count;
+} idm_table_t;
+
+/**
+ * Description:
+ *   Empties table `t`.
+ */
+void idm_init(idm_table_t *t);
+
+/**
+ * Description:
+ *   Appends a rule matching `filter` under `mask`, for frame type `type`
+ *   (IDM_ANY, IDM_SID or IDM_EID). Rules are tried in the order they were
+ *   added.
+ *
+ * Returns (int16_t):
+ *   0..N - index of the rule
+ *  -1 - Table full
+ */
+int16_t idm_add(idm_table_t *t, uint32_t filter, uint32_t mask, uint8_t type);
+
+/**
+ * Description:
+ *   Finds the first rule of `t` accepting Id `id`, extended when `ext` is set.
+ *
+ * Returns (int16_t):
+ *   0..N - index of the first matching rule
+ *  -1 - No rule matches
+ */
+int16_t idm_match(const idm_table_t *t, uint32_t id, uint8_t ext);
+
+/**
+ * Description:
+ *   Same as idm_match(), one rule at a time. The reference the vector paths
+ *   are checked against.
+ */
+int16_t idm_match_scalar(const idm_table_t *t, uint32_t id, uint8_t ext);
+
+#endif /* _IDMATCH_H_ */
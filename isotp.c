@@ -0,0 +1,374 @@
+#include <string.h>
+#include <stdint.h>
+
+#include "isotp.h"
+
+#define ISOTP_PCI_SF          0x00  // single frame
+#define ISOTP_PCI_FF          0x10  // first frame
+#define ISOTP_PCI_CF          0x20  // consecutive frame
+#define ISOTP_PCI_FC          0x30  // flow control
+
+#define ISOTP_FC_CTS          0x00  // continue to send
+#define ISOTP_FC_WAIT         0x01
+#define ISOTP_FC_OVFLW        0x02  // overflow, abort
+
+typedef enum
+{
+   ISOTP_RX_FREE = 0,
+   ISOTP_RX_BUSY,       // consecutive frames still expected
+   ISOTP_RX_DONE        // complete, waiting in isotp_done_buf
+} isotp_rx_state_t;
+
+typedef enum
+{
+   ISOTP_TX_IDLE = 0,
+   ISOTP_TX_WAIT_FC,
+   ISOTP_TX_SENDING
+} isotp_tx_state_t;
+
+typedef struct
+{
+   uint8_t state;
+   uint32_t id;            // sender this buffer is reassembling for
+   uint16_t length;        // total length announced in the first frame
+   uint16_t offset;        // bytes received so far
+   uint8_t sn;             // next expected sequence number
+   uint8_t bs_count;       // consecutive frames left in this block
+   uint32_t last_ms;
+   uint8_t data[ISOTP_MAX_PAYLOAD];
+} isotp_rx_session_t;
+
+typedef struct
+{
+   uint8_t state;
+   uint16_t length;
+   uint16_t offset;
+   uint8_t sn;
+   uint8_t bs;             // block size granted by the receiver
+   uint8_t bs_count;
+   uint8_t stmin;          // in ms
+   uint32_t last_ms;
+   uint8_t data[ISOTP_MAX_PAYLOAD];
+} isotp_tx_session_t;
+
+// Reassembly buffer pool, no dynamic memory. Completed buffers are queued by
+// index so the consumer gets them in completion order.
+isotp_rx_session_t isotp_rx_pool[ISOTP_RX_BUFFERS];
+isotp_tx_session_t isotp_tx;
+
+CIRCBUF_DEF(uint8_t, isotp_done_buf, ISOTP_RX_BUFFERS);
+
+void isotp_init()
+{
+   for ( uint8_t i = 0 ; i < ISOTP_RX_BUFFERS ; i++ )
+      isotp_rx_pool[i].state = ISOTP_RX_FREE;
+   isotp_tx.state = ISOTP_TX_IDLE;
+   CIRCBUF_FLUSH(isotp_done_buf);
+}
+
+static int16_t isotp_send_fc(uint8_t status)
+{
+   uint8_t fc[3];
+
+   fc[0] = ISOTP_PCI_FC | status;
+   fc[1] = ISOTP_BLOCK_SIZE;
+   fc[2] = ISOTP_STMIN;
+   // the sender is waiting on it, don't let the error passive budget hold it
+   return can_pack_id_prio(STBoard.can_address, fc, 3, 3);
+}
+
+// Converts a received STmin byte to whole ms. The 100-900 us range rounds up
+// to 1 ms, reserved values are treated as the 127 ms maximum.
+static uint8_t isotp_stmin_ms(uint8_t stmin)
+{
+   if (stmin <= 0x7F)
+      return stmin;
+   if (stmin >= 0xF1 && stmin <= 0xF9)
+      return 1;
+   return 0x7F;
+}
+
+static isotp_rx_session_t *isotp_rx_find(uint32_t id)
+{
+   for ( uint8_t i = 0 ; i < ISOTP_RX_BUFFERS ; i++ )
+   {
+      if (isotp_rx_pool[i].state == ISOTP_RX_BUSY && isotp_rx_pool[i].id == id)
+         return &isotp_rx_pool[i];
+   }
+   return NULL;
+}
+
+static isotp_rx_session_t *isotp_rx_alloc(uint32_t id)
+{
+   isotp_rx_session_t *s;
+
+   // A new first/single frame from the same sender replaces the old one
+   s = isotp_rx_find(id);
+   if (s)
+      return s;
+
+   for ( uint8_t i = 0 ; i < ISOTP_RX_BUFFERS ; i++ )
+   {
+      if (isotp_rx_pool[i].state == ISOTP_RX_FREE)
+         return &isotp_rx_pool[i];
+   }
+   return NULL;
+}
+
+static void isotp_rx_complete(isotp_rx_session_t *s)
+{
+   uint8_t idx = s - isotp_rx_pool;
+
+   s->state = ISOTP_RX_DONE;
+   isotp_done_buf_push_refd(&idx);  // cannot be full, one slot per buffer
+}
+
+static int16_t isotp_rx_single(can_rx_frame_t *frame)
+{
+   isotp_rx_session_t *s;
+   uint8_t len = frame->data[0] & 0x0F;
+
+   if (len == 0 || len > 7 || len > frame->header.Length - 1)
+      return -1;
+
+   s = isotp_rx_alloc(frame->header.Id);
+   if (!s)
+      return -1;
+
+   s->id = frame->header.Id;
+   s->length = len;
+   s->offset = len;
+   memcpy(s->data, &frame->data[1], len);
+   isotp_rx_complete(s);
+   return 0;
+}
+
+static int16_t isotp_rx_first(can_rx_frame_t *frame)
+{
+   isotp_rx_session_t *s;
+   uint16_t len;
+
+   if (frame->header.Length != 8)
+      return -1;
+
+   len = ((uint16_t)(frame->data[0] & 0x0F) << 8) | frame->data[1];
+   if (len < 8)
+      return -1;  // should have been a single frame
+
+   s = NULL;
+   if (len <= ISOTP_MAX_PAYLOAD)
+      s = isotp_rx_alloc(frame->header.Id);
+   if (!s)
+   {
+      isotp_send_fc(ISOTP_FC_OVFLW);
+      return -1;
+   }
+
+   s->state = ISOTP_RX_BUSY;
+   s->id = frame->header.Id;
+   s->length = len;
+   s->offset = 6;
+   s->sn = 1;
+   s->bs_count = ISOTP_BLOCK_SIZE;
+   s->last_ms = *STBoard.milliseconds;
+   memcpy(s->data, &frame->data[2], 6);
+
+   isotp_send_fc(ISOTP_FC_CTS);
+   return 0;
+}
+
+static int16_t isotp_rx_consecutive(can_rx_frame_t *frame)
+{
+   isotp_rx_session_t *s;
+   uint16_t n;
+
+   s = isotp_rx_find(frame->header.Id);
+   if (!s)
+      return -1;  // no first frame seen, ignore
+
+   if ((frame->data[0] & 0x0F) != s->sn)
+   {
+      s->state = ISOTP_RX_FREE;  // lost a frame, drop the whole message
+      return -1;
+   }
+   s->sn = (s->sn + 1) & 0x0F;
+   s->last_ms = *STBoard.milliseconds;
+
+   n = s->length - s->offset;
+   if (n > 7)
+      n = 7;
+   if (frame->header.Length < n + 1)
+   {
+      s->state = ISOTP_RX_FREE;
+      return -1;
+   }
+   memcpy(&s->data[s->offset], &frame->data[1], n);
+   s->offset += n;
+
+   if (s->offset >= s->length)
+   {
+      isotp_rx_complete(s);
+      return 0;
+   }
+
+   if (ISOTP_BLOCK_SIZE && --s->bs_count == 0)
+   {
+      s->bs_count = ISOTP_BLOCK_SIZE;
+      isotp_send_fc(ISOTP_FC_CTS);
+   }
+   return 0;
+}
+
+static int16_t isotp_rx_flow_control(can_rx_frame_t *frame)
+{
+   if (isotp_tx.state == ISOTP_TX_IDLE || frame->header.Length < 3)
+      return -1;
+
+   switch (frame->data[0] & 0x0F)
+   {
+   case ISOTP_FC_CTS:
+      isotp_tx.state = ISOTP_TX_SENDING;
+      isotp_tx.bs = frame->data[1];
+      isotp_tx.bs_count = isotp_tx.bs;
+      isotp_tx.stmin = isotp_stmin_ms(frame->data[2]);
+      isotp_tx.last_ms = *STBoard.milliseconds;
+      isotp_poll();  // start sending right away, don't wait for the next tick
+      return 0;
+   case ISOTP_FC_WAIT:
+      isotp_tx.last_ms = *STBoard.milliseconds;
+      return 0;
+   default:  // overflow or invalid, receiver can't take it
+      isotp_tx.state = ISOTP_TX_IDLE;
+      return -1;
+   }
+}
+
+int16_t isotp_rx_frame(can_rx_frame_t *frame)
+{
+   if ((frame->header.Id & ISOTP_RX_ID_MASK) != ISOTP_RX_ID)
+      return 1;
+   if (frame->header.rtr || frame->header.Length == 0)
+      return -1;
+
+   switch (frame->data[0] & 0xF0)
+   {
+   case ISOTP_PCI_SF:
+      return isotp_rx_single(frame);
+   case ISOTP_PCI_FF:
+      return isotp_rx_first(frame);
+   case ISOTP_PCI_CF:
+      return isotp_rx_consecutive(frame);
+   case ISOTP_PCI_FC:
+      return isotp_rx_flow_control(frame);
+   default:
+      return -1;
+   }
+}
+
+int16_t isotp_receive(uint8_t *data, uint16_t max)
+{
+   isotp_rx_session_t *s;
+   uint8_t idx;
+   uint16_t len;
+
+   if (isotp_done_buf_pop_refd(&idx))
+      return -1;  // Empty
+
+   s = &isotp_rx_pool[idx];
+   len = s->length;
+   if (len > max)
+      len = max;
+   memcpy(data, s->data, len);
+   s->state = ISOTP_RX_FREE;
+   return len;
+}
+
+int16_t isotp_send(uint8_t *data, uint16_t len)
+{
+   uint8_t frame[8];
+
+   if (len == 0 || len > ISOTP_MAX_PAYLOAD || isotp_tx.state != ISOTP_TX_IDLE)
+      return -1;
+
+   if (len <= 7)
+   {
+      frame[0] = ISOTP_PCI_SF | len;
+      memcpy(&frame[1], data, len);
+      return can_pack_id(STBoard.can_address, frame, len + 1);
+   }
+
+   frame[0] = ISOTP_PCI_FF | (len >> 8);
+   frame[1] = len & 0xFF;
+   memcpy(&frame[2], data, 6);
+   if (can_pack_id(STBoard.can_address, frame, 8))
+      return -1;
+
+   memcpy(isotp_tx.data, data, len);
+   isotp_tx.length = len;
+   isotp_tx.offset = 6;
+   isotp_tx.sn = 1;
+   isotp_tx.last_ms = *STBoard.milliseconds;
+   isotp_tx.state = ISOTP_TX_WAIT_FC;
+   return 0;
+}
+
+static void isotp_tx_poll()
+{
+   uint8_t frame[8];
+   uint16_t n;
+   uint32_t now = *STBoard.milliseconds;
+
+   if (isotp_tx.state == ISOTP_TX_WAIT_FC)
+   {
+      if (now - isotp_tx.last_ms >= ISOTP_TIMEOUT_MS)
+         isotp_tx.state = ISOTP_TX_IDLE;  // N_Bs expired
+      return;
+   }
+   if (isotp_tx.state != ISOTP_TX_SENDING)
+      return;
+
+   // With STmin 0 fill the TX ring in one go, otherwise one frame per STmin
+   while (CIRCBUF_FS(tx_ring_buf) > 0)
+   {
+      if (isotp_tx.stmin && now - isotp_tx.last_ms < isotp_tx.stmin)
+         return;
+
+      n = isotp_tx.length - isotp_tx.offset;
+      if (n > 7)
+         n = 7;
+      frame[0] = ISOTP_PCI_CF | isotp_tx.sn;
+      memcpy(&frame[1], &isotp_tx.data[isotp_tx.offset], n);
+      if (can_pack_id(STBoard.can_address, frame, n + 1))
+         return;
+
+      isotp_tx.sn = (isotp_tx.sn + 1) & 0x0F;
+      isotp_tx.offset += n;
+      isotp_tx.last_ms = now;
+
+      if (isotp_tx.offset >= isotp_tx.length)
+      {
+         isotp_tx.state = ISOTP_TX_IDLE;
+         return;
+      }
+      if (isotp_tx.bs && --isotp_tx.bs_count == 0)
+      {
+         isotp_tx.state = ISOTP_TX_WAIT_FC;
+         return;
+      }
+      if (isotp_tx.stmin)
+         return;
+   }
+}
+
+void isotp_poll()
+{
+   uint32_t now = *STBoard.milliseconds;
+
+   for ( uint8_t i = 0 ; i < ISOTP_RX_BUFFERS ; i++ )
+   {
+      if (isotp_rx_pool[i].state == ISOTP_RX_BUSY &&
+          now - isotp_rx_pool[i].last_ms >= ISOTP_TIMEOUT_MS)
+         isotp_rx_pool[i].state = ISOTP_RX_FREE;  // N_Cr expired
+   }
+   isotp_tx_poll();
+}
@@ -0,0 +1,118 @@
+#ifndef _ISOTP_H_
+#define _ISOTP_H_
+
+#include <stdint.h>
+
+// ISO 15765-2 (ISO-TP) segmentation and reassembly on top of the CAN rings.
+// Frames come in through rx_ring_buf and go out through tx_ring_buf, so this
+// layer never touches the ECAN peripheral itself.  Normal addressing, classic
+// CAN (8 byte frames) only.
+
+/**
+ * Description:
+ *   Largest payload in bytes that can be reassembled or segmented. Every
+ *   buffer in the reassembly pool is this size. ISO 15765-2 allows up to 4095
+ *   on classic CAN.
+ */
+#ifndef ISOTP_MAX_PAYLOAD
+#define ISOTP_MAX_PAYLOAD     128
+#endif
+
+/**
+ * Description:
+ *   Number of preallocated reassembly buffers. One buffer is in use while a
+ *   message is assembled and stays in use until the consumer picks it up with
+ *   isotp_receive(), so 2 lets a new message arrive while the last one waits.
+ */
+#ifndef ISOTP_RX_BUFFERS
+#define ISOTP_RX_BUFFERS      2
+#endif
+
+/**
+ * Description:
+ *   Flow control we advertise to senders. Block size is the number of
+ *   consecutive frames before the sender waits for the next flow control
+ *   (0 = send everything), STmin the separation time between consecutive
+ *   frames in ms (0 = back to back, full bus rate).
+ */
+#ifndef ISOTP_BLOCK_SIZE
+#define ISOTP_BLOCK_SIZE      0
+#endif
+
+#ifndef ISOTP_STMIN
+#define ISOTP_STMIN           0
+#endif
+
+/**
+ * Description:
+ *   Received frames whose Id matches ISOTP_RX_ID under ISOTP_RX_ID_MASK are
+ *   treated as ISO-TP frames. Reassembly is tracked per exact Id, so a mask
+ *   lets several senders segment at once. Our own frames (flow control and
+ *   segmented TX) use STBoard.can_address, like can_pack().
+ */
+#ifndef ISOTP_RX_ID
+#define ISOTP_RX_ID           0x7E0
+#endif
+
+#ifndef ISOTP_RX_ID_MASK
+#define ISOTP_RX_ID_MASK      0x7FF
+#endif
+
+/**
+ * Description:
+ *   N_Bs / N_Cr timeout in ms. A reassembly that sees no consecutive frame, or
+ *   a transfer that sees no flow control, for this long is dropped.
+ */
+#ifndef ISOTP_TIMEOUT_MS
+#define ISOTP_TIMEOUT_MS      1000
+#endif
+
+/**
+ * Description:
+ *   Resets all reassembly buffers and any transfer in progress.
+ */
+void isotp_init();
+
+/**
+ * Description:
+ *   Feeds one frame popped from rx_ring_buf into the transport layer.
+ *
+ * Returns (int16_t):
+ *   0 - Frame consumed by ISO-TP
+ *   1 - Not an ISO-TP frame, caller should handle it
+ *  -1 - ISO-TP frame dropped (protocol error or no free buffer)
+ */
+int16_t isotp_rx_frame(can_rx_frame_t *frame);
+
+/**
+ * Description:
+ *   Copies the oldest completely reassembled message into `data` and returns
+ *   its buffer to the pool. Messages longer than `max` are truncated.
+ *
+ * Returns (int16_t):
+ *   0..N - number of bytes copied
+ *  -1 - No message waiting
+ */
+int16_t isotp_receive(uint8_t *data, uint16_t max);
+
+/**
+ * Description:
+ *   Starts sending `len` bytes. Up to 7 bytes go out as a single frame,
+ *   anything longer as a first frame followed by consecutive frames paced by
+ *   the receiver's flow control. The payload is copied, `data` may be reused
+ *   as soon as this returns.
+ *
+ * Returns (int16_t):
+ *   0 - Transfer started
+ *  -1 - Too long, a transfer is already in progress or TX ring is full
+ */
+int16_t isotp_send(uint8_t *data, uint16_t len);
+
+/**
+ * Description:
+ *   Pushes due consecutive frames into tx_ring_buf and expires stale
+ *   sessions. Call as often as can_tx() drains the TX ring.
+ */
+void isotp_poll();
+
+#endif /* _ISOTP_H_ */
@@ -0,0 +1,117 @@
+#include <string.h>
+#include <stdint.h>
+#if defined(__linux__)
+#include <time.h>
+#endif
+
+#include "latency.h"
+
+lat_hist_t lat_hist;
+
+#if defined(__linux__)
+
+void lat_init()
+{
+   lat_reset();
+}
+
+uint32_t lat_now()
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint32_t)((uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+}
+
+#else
+
+uint16_t lat_overflows;   // upper 16 bits of the timestamp
+
+#INT_TIMER1
+void lat_timer_isr()
+{
+   lat_overflows++;
+}
+
+void lat_init()
+{
+   lat_overflows = 0;
+   lat_reset();
+   LAT_TIMER_SETUP();
+   set_timer1(0);
+   enable_interrupts(INT_TIMER1);
+}
+
+uint32_t lat_now()
+{
+   uint16_t hi, lo;
+
+   do {
+      hi = lat_overflows;
+      lo = get_timer1();
+   } while (hi != lat_overflows);
+
+   // Called from another ISR the overflow may still be pending
+   if (interrupt_active(INT_TIMER1) && lo < 0x8000)
+      hi++;
+   return ((uint32_t)hi << 16) | lo;
+}
+
+#endif
+
+void lat_reset()
+{
+   memset(&lat_hist, 0, sizeof(lat_hist));
+}
+
+void lat_record(uint32_t since)
+{
+   uint32_t ticks = lat_now() - since;
+   uint32_t v = ticks;
+   uint8_t b = 0;
+
+   while (v && b < LAT_BUCKETS - 1) {
+      v >>= 1;
+      b++;
+   }
+   lat_hist.bucket[b]++;
+   lat_hist.count++;
+   if (ticks > lat_hist.max)
+      lat_hist.max = ticks;
+}
+
+// LAT_TICK_NS must divide 1000, no 64 bit math on the PIC
+#define LAT_TICKS_PER_US      (1000 / LAT_TICK_NS)
+
+static uint32_t lat_ticks_to_us(uint32_t ticks)
+{
+   return ticks / LAT_TICKS_PER_US + (ticks % LAT_TICKS_PER_US != 0);
+}
+
+uint32_t lat_percentile_us(uint8_t pct)
+{
+   uint32_t want, seen = 0;
+   uint8_t b;
+
+   if (lat_hist.count == 0)
+      return 0;
+
+   want = lat_hist.count / 100 * pct + ((lat_hist.count % 100) * pct + 99) / 100;
+   if (want == 0)
+      want = 1;
+   for (b = 0; b < LAT_BUCKETS - 1; b++) {
+      seen += lat_hist.bucket[b];
+      if (seen >= want)
+         break;
+   }
+   if (b == 0)
+      return 0;
+   if (b == LAT_BUCKETS - 1 || ((uint32_t)1 << b) - 1 > lat_hist.max)
+      return lat_max_us();
+   return lat_ticks_to_us(((uint32_t)1 << b) - 1);
+}
+
+uint32_t lat_max_us()
+{
+   return lat_ticks_to_us(lat_hist.max);
+}
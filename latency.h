@@ -0,0 +1,80 @@
+#ifndef _LATENCY_H_
+#define _LATENCY_H_
+
+#include <stdint.h>
+
+// High resolution timestamps and a log2 bucketed latency histogram, used to
+// measure how long received frames wait in rx_ring_buf before a consumer
+// takes them.
+
+/**
+ * Description:
+ *   Length of one timestamp tick in ns. On the PIC timestamps come from
+ *   Timer1 (Fosc/4 / 8 = 2 MHz at 64 MHz), extended to 32 bits in software.
+ *   On a Linux host they come from clock_gettime(CLOCK_MONOTONIC) in us.
+ */
+#ifndef LAT_TICK_NS
+#if defined(__linux__)
+#define LAT_TICK_NS           1000
+#else
+#define LAT_TICK_NS           500
+#endif
+#endif
+
+#ifndef LAT_TIMER_SETUP
+#define LAT_TIMER_SETUP()     setup_timer_1(T1_INTERNAL | T1_DIV_BY_8)
+#endif
+
+/**
+ * Description:
+ *   Number of histogram buckets. Bucket 0 holds latencies of 0 ticks, bucket
+ *   n holds [2^(n-1), 2^n) ticks, the last one everything above.
+ */
+#define LAT_BUCKETS           28
+
+typedef struct
+{
+   uint32_t count;
+   uint32_t max;              // in ticks
+   uint32_t bucket[LAT_BUCKETS];
+} lat_hist_t;
+
+/**
+ * Description:
+ *   Starts the timestamp clock and clears the histogram.
+ */
+void lat_init();
+
+/**
+ * Description:
+ *   Current timestamp in ticks. Safe to call from an ISR.
+ */
+uint32_t lat_now();
+
+/**
+ * Description:
+ *   Adds the time elapsed since timestamp `since` to the histogram.
+ */
+void lat_record(uint32_t since);
+
+/**
+ * Description:
+ *   Clears the histogram.
+ */
+void lat_reset();
+
+/**
+ * Description:
+ *   Returns the `pct` percentile (0-100) of the recorded latencies in us,
+ *   rounded up to the end of its bucket but never above the maximum. 0 if
+ *   nothing was recorded.
+ */
+uint32_t lat_percentile_us(uint8_t pct);
+
+/**
+ * Description:
+ *   Returns the largest recorded latency in us.
+ */
+uint32_t lat_max_us();
+
+#endif /* _LATENCY_H_ */
@@ -0,0 +1,94 @@
+#include <string.h>
+#include <stdint.h>
+
+#include "lowpower.h"
+
+lp_stats_t lp_stats;
+uint32_t lp_report_at;           // lat_now() of the last lp_print_stats()
+lp_stats_t lp_reported;          // lp_stats at that time
+
+// Only ends an Idle mode sleep. TMR0IF stays set so rtos_run() still sees the
+// tick, the interrupt is turned off instead and lp_idle() arms it again.
+#INT_TIMER0 NOCLEAR
+void lp_tick_isr()
+{
+   disable_interrupts(INT_TIMER0);
+}
+
+void lp_init()
+{
+   memset(&lp_stats, 0, sizeof(lp_stats));
+   memset(&lp_reported, 0, sizeof(lp_reported));
+   lp_report_at = lat_now();
+   LP_TIMER_SETUP();
+}
+
+void lp_idle()
+{
+   uint32_t start;
+
+   if (LP_BUSY())
+   {
+      lp_stats.busy++;
+      return;
+   }
+
+   // Interrupts stay off from the check to the SLEEP, so a frame or a tick
+   // arriving in between wakes us at once instead of being slept through.
+   // Enabled sources still end the sleep, their handlers run after.
+   disable_interrupts(GLOBAL);
+   if (interrupt_active(INT_TIMER0))
+   {
+      enable_interrupts(GLOBAL);
+      return;  // a task is due already
+   }
+   enable_interrupts(INT_TIMER0);
+   start = lat_now();
+   sleep(SLEEP_IDLE);
+   delay_cycles(1);
+   lp_stats.asleep += lat_now() - start;
+   lp_stats.sleeps++;
+   if (interrupt_active(INT_TIMER0))
+      lp_stats.tick_wakes++;
+   else
+      lp_stats.irq_wakes++;
+   enable_interrupts(GLOBAL);
+}
+
+#ifdef LP_CAN_WAKE
+void lp_sleep_until_bus()
+{
+   lp_stats.deep_sleeps++;
+   can_set_mode(CAN_OP_DISABLE, FALSE);
+   can_clear_interrupt(CAN_INTERRUPT_WAKE);
+   can_enable_interrupts(CAN_INTERRUPT_WAKE);  // can_err_isr() counts it
+   sleep(SLEEP_FULL);
+   delay_cycles(1);
+   can_disable_interrupts(CAN_INTERRUPT_WAKE);
+   can_set_mode(CAN_OP_NORMAL, FALSE);
+}
+#endif
+
+void lp_print_stats()
+{
+   uint32_t now = lat_now();
+   uint32_t span = lat_ticks_to_us(now - lp_report_at) / 1000;   // ms
+   uint32_t wakes, asleep;
+
+   wakes = lp_stats.tick_wakes + lp_stats.irq_wakes
+         - lp_reported.tick_wakes - lp_reported.irq_wakes;
+   asleep = lat_ticks_to_us(lp_stats.asleep - lp_reported.asleep) / 1000;
+   if (span == 0)
+      span = 1;
+
+   fprintf(RS232_U1,
+      "[%8Lu]:LP:wakes/s[%Lu] irq/s[%Lu] asleep[%Lu%%] sleeps[%Lu]"
+      " busy[%Lu] deep[%Lu] can_wakes[%Lu]\r\n",
+      lat_ticks_to_us(now) / 1000, wakes * 1000 / span,
+      (lp_stats.irq_wakes - lp_reported.irq_wakes) * 1000 / span,
+      asleep * 100 / span, lp_stats.sleeps, lp_stats.busy,
+      lp_stats.deep_sleeps, lp_stats.can_wakes );
+
+   lp_report_at = now;
+   lp_reported = lp_stats;
+}
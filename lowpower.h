@@ -0,0 +1,88 @@
+#ifndef _LOWPOWER_H_
+#define _LOWPOWER_H_
+
+#include <stdint.h>
+
+// Low-power idle for the RTOS main loop. lp_idle() runs as the last task of
+// every minor cycle and puts the core in Idle mode (peripheral clocks keep
+// running) until the next RTOS tick or any enabled interrupt, normally a CAN
+// frame arriving. rtos_run() counts Timer0 overflows, so in this mode Timer0
+// overflows once per minor cycle instead of every 16 us, and its interrupt
+// only ends the sleep: the handler leaves the flag set for rtos_run().
+//
+// With LP_CAN_WAKE, lp_sleep_until_bus() stops every clock until the ECAN
+// sees activity on a silent bus, for applications that have nothing
+// scheduled in the meantime.
+
+/**
+ * Description:
+ *   Timer0 setup giving one overflow per RTOS minor cycle, 1 ms at 64 MHz
+ *   (Fosc/4 / 64 / 250). Must match minor_cycle in #use rtos.
+ */
+#ifndef LP_TIMER_SETUP
+#define LP_TIMER_SETUP()      setup_timer_0(RTCC_INTERNAL | RTCC_DIV_64 | RTCC_8_BIT, 249)
+#endif
+
+/**
+ * Description:
+ *   TRUE while the application still has queued work, lp_idle() returns
+ *   without sleeping so the backlog is drained in one batch first.
+ */
+#ifndef LP_BUSY
+#define LP_BUSY()             FALSE
+#endif
+
+// #define LP_CAN_WAKE
+
+#ifdef LP_CAN_WAKE
+#ifndef CAN_BRG_WAKE_FILTER
+#define CAN_BRG_WAKE_FILTER   1     // ignore glitches on the bus lines
+#endif
+#endif
+
+typedef struct
+{
+   uint32_t sleeps;
+   uint32_t tick_wakes;       // woken by the RTOS tick
+   uint32_t irq_wakes;        // by anything else, normally a CAN frame
+   uint32_t busy;             // lp_idle() calls that found work queued
+   uint32_t asleep;           // lat_now() ticks spent in Idle mode
+   uint32_t deep_sleeps;      // lp_sleep_until_bus() calls
+   uint32_t can_wakes;        // ended by bus activity
+} lp_stats_t;
+
+extern lp_stats_t lp_stats;
+
+/**
+ * Description:
+ *   Sets up Timer0 for the RTOS with LP_TIMER_SETUP() and clears the
+ *   statistics. Call in place of setup_timer_0(), after lat_init().
+ */
+void lp_init();
+
+/**
+ * Description:
+ *   Sleeps in Idle mode until the next RTOS tick or any other enabled
+ *   interrupt, unless a tick is already pending or LP_BUSY().
+ */
+void lp_idle();
+
+#ifdef LP_CAN_WAKE
+/**
+ * Description:
+ *   Disables the ECAN and stops the clocks until the bus wakes it up. The
+ *   RTOS and lat_now() stand still meanwhile, and the frame that woke us is
+ *   not received. Needs the CAN1 interrupt enabled, see can_err_init().
+ */
+void lp_sleep_until_bus();
+#endif
+
+/**
+ * Description:
+ *   Prints wakeups per second and the share of time asleep since the last
+ *   call, then the running totals. Lines are stamped with lat_now() in ms,
+ *   it also runs in applications without the canbus layer.
+ */
+void lp_print_stats();
+
+#endif /* _LOWPOWER_H_ */
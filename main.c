@@ -9,19 +9,56 @@ typedef struct {
     uint8_t counter;
 } can_rx_frame_t;
 
+// Wake the consumer from the push instead of polling the ring
+#define CIRCBUF_ENABLE_NOTIFY
+#define CIRCBUF_ON_EVENT(cb, ev)    circbuf_event(cb, ev)
+
 #include "circbuf.h"
+void circbuf_event(circbuf_t *cb, int ev);
 #include "circbuf.c"
+#include "latency.h"
+#include "latency.c"
 #include "util.h"
 
+// Sleep between RTOS ticks instead of spinning in rtos_run()
+#define LOW_POWER_IDLE
+
 #use rs232(baud=115200,parity=N,xmit=PIN_C7,rcv=PIN_C6,bits=8,stream=RS232_U1,UART1,RECEIVE_BUFFER=2,errors)
 
 #use rtos(timer=0,minor_cycle=1ms)
 
+// Stands in for the CAN RX ISR, pushes one frame a second
 #task(rate=1000ms,max=1ms,enabled=TRUE)
+void producer();
+
+// Only runs while my_circ_buf has data, enabled by circbuf_event()
+#task(rate=1ms,max=1ms,enabled=FALSE)
 int16_t application();
 
+#ifdef LOW_POWER_IDLE
+#task(rate=1000ms,max=1ms)
+void power_report();
+
+// Declared last so it runs last in every minor cycle
+#task(rate=1ms,max=1ms)
+void idle();
+#endif
+
 CIRCBUF_DEF(can_rx_frame_t, my_circ_buf, 32)
 
+#ifdef LOW_POWER_IDLE
+// Don't sleep on a backlog, application() drains it first
+#define LP_BUSY()    (CIRCBUF_FS(my_circ_buf) != my_circ_buf.size)
+#include "lowpower.h"
+#include "lowpower.c"
+#endif
+
+void circbuf_event(circbuf_t *cb, int ev)
+{
+   if (cb == &my_circ_buf && (ev & CIRCBUF_EVT_NONEMPTY))
+      rtos_enable(application);
+}
+
 
 //!can_rx_frame_t my_circ_buf_circbuf_data[32]; 
 //!circbuf_t my_circ_buf = { 
@@ -43,34 +80,61 @@ CIRCBUF_DEF(can_rx_frame_t, my_circ_buf, 32)
 //!
 
 
-int16_t application()
+void producer()
 {
+    static uint8_t counter = 0;
     can_rx_frame_t in_frame;
-    can_rx_frame_t out_frame;
-    
+
     in_frame.can_header = 1;
-    out_frame.can_header = 0; //overwrite me
+    in_frame.counter = counter++;
 
     if (my_circ_buf_push_refd(&in_frame)) {
         printf("Out of space in CB\n");
-        return -1;
+        return;
     }
+    printf("Push: 0x%x\n", in_frame.counter);
+}
+
+int16_t application()
+{
+    can_rx_frame_t out_frame;
 
-    if (my_circ_buf_pop_refd(&out_frame)) {
-        printf("CB is empty\n");
-        return -1;
+    // drain everything queued since we were woken
+    while (my_circ_buf_pop_refd(&out_frame) == 0) {
+        // here is the data
+        printf("Pop:  0x%x\n", out_frame.counter);
     }
 
-    // here is the data
-    printf("Push: 0x%x\n", in_frame.can_header);
-    printf("Pop:  0x%x\n", out_frame.can_header);
+    // go back to sleep, unless a push slipped in after the last pop
+    rtos_disable(application);
+    if (CIRCBUF_FS(my_circ_buf) != my_circ_buf.size)
+        rtos_enable(application);
     return 0;
 }
 
 
+#ifdef LOW_POWER_IDLE
+void power_report()
+{
+   lp_print_stats();
+}
+
+void idle()
+{
+   lp_idle();
+}
+#endif
+
+
 void main()
 {
+   lat_init();
+#ifdef LOW_POWER_IDLE
+   lp_init();                                               //1 ms overflow
+#else
    setup_timer_0(RTCC_INTERNAL|RTCC_DIV_1|RTCC_8_BIT);      //16.0 us overflow
+#endif
+   enable_interrupts(GLOBAL);
    while(TRUE)
    {
       rtos_run ( );
@@ -0,0 +1,41 @@
+#include <string.h>
+#include <stdint.h>
+
+#include "pool.h"
+
+pool_handle_t __pool_alloc(pool_t *pool)
+{
+   pool_handle_t h;
+
+   if (pool->free_count)
+      h = pool->free_list[--pool->free_count];
+   else if (pool->fresh < pool->count)
+      h = pool->fresh++;
+   else
+      return POOL_NONE; // Exhausted
+
+   pool->busy[h >> 3] |= 1 << (h & 7);
+   pool->used++;
+   if (pool->used > pool->peak)
+      pool->peak = pool->used;
+   return h;
+}
+
+int __pool_free(pool_t *pool, pool_handle_t h)
+{
+   if (h >= pool->fresh || !(pool->busy[h >> 3] & (1 << (h & 7))))
+      return -1; // never handed out, or double free
+
+   pool->busy[h >> 3] &= ~(1 << (h & 7));
+   pool->free_list[pool->free_count++] = h;
+   pool->used--;
+   return 0;
+}
+
+void __pool_flush(pool_t *pool)
+{
+   pool->free_count = 0;
+   pool->fresh = 0;
+   pool->used = 0;
+   memset(pool->busy, 0, ((uint16_t)pool->count + 7) / 8);  // 8 bit int on CCS
+}
@@ -0,0 +1,142 @@
+#ifndef _UTIL_POOL_H_
+#define _UTIL_POOL_H_
+
+#include <stdint.h>
+
+/**
+ * Description:
+ *   Handle to a block in a pool. Handles are small enough to be pushed into a
+ *   circbuf in place of the block itself, so moving a block between rings
+ *   never copies its contents.
+ */
+typedef uint8_t pool_handle_t;
+
+#define POOL_NONE             0xFF  // no block, pools hold at most 255 blocks
+
+/** --- Internal methods and structures. DON'T USE --------------------------- */
+typedef struct {
+   void * blocks;
+   uint8_t * free_list;    // stack of released block indexes
+   uint8_t * busy;         // one bit per block, set while it is handed out
+   uint8_t free_count;
+   uint8_t fresh;          // blocks never handed out yet, taken from the end
+   uint8_t count;
+   uint8_t used;
+   uint8_t peak;           // high-water mark of `used`
+   uint16_t block_size;
+} pool_t;
+
+// Adds 0 to an array size, or stops the build when `n` blocks would not fit
+// below POOL_NONE (same trick as BUILD_ASSERT_OR_ZERO in util.h)
+#define __POOL_CHECK_SIZE(n)   (sizeof(char [1 - 2*!((n) > 0 && (n) < POOL_NONE)]) - 1)
+
+#define __POOL_VAR_DEF(type, pool, n)     \
+   type pool ## _pool_data[n];            \
+   uint8_t pool ## _pool_free[(n) + __POOL_CHECK_SIZE(n)]; \
+   uint8_t pool ## _pool_busy[((n) + 7) / 8];  \
+   pool_t pool= {                         \
+      pool ## _pool_data,                 \
+      pool ## _pool_free,                 \
+      pool ## _pool_busy,                 \
+      0,                                  \
+      0,                                  \
+      n,                                  \
+      0,                                  \
+      0,                                  \
+      sizeof(type)                        \
+   };
+
+pool_handle_t __pool_alloc(pool_t *pool);
+int __pool_free(pool_t *pool, pool_handle_t h);
+void __pool_flush(pool_t *pool);
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Description:
+ *   Critical section around the free list for callers outside of an ISR, the
+ *   circbuf.h lock so it nests inside CIRCBUF_LOCK() sections and leaves
+ *   interrupts as it found them. Interrupt handlers use POOL_ALLOC_ISR /
+ *   POOL_FREE_ISR, which take no lock at all.
+ */
+#ifndef POOL_LOCK
+#include "circbuf.h"
+#define POOL_LOCK()           CIRCBUF_LOCK()
+#define POOL_UNLOCK()         CIRCBUF_UNLOCK()
+#endif
+
+/**
+ * Description:
+ *   Defines a global pool `pool` of `n` fixed size blocks of `type`, 1..254
+ *   (checked at build time). Allocation and release are O(1) and never touch
+ *   the heap.
+ *
+ * Usage:
+ *   POOL_DEF(can_frame_t, frame_pool, 48);
+ */
+#define POOL_DEF(type, pool, n)           \
+   __POOL_VAR_DEF(type, pool, n)          \
+   type * pool ## _ptr(pool_handle_t h)   \
+   {                                      \
+      return &pool ## _pool_data[h];      \
+   }                                      \
+   pool_handle_t pool ## _alloc()         \
+   {                                      \
+      pool_handle_t h;                    \
+      POOL_LOCK();                        \
+      h = __pool_alloc(&pool);            \
+      POOL_UNLOCK();                      \
+      return h;                           \
+   }                                      \
+   int pool ## _free(pool_handle_t h)     \
+   {                                      \
+      int ret;                            \
+      POOL_LOCK();                        \
+      ret = __pool_free(&pool, h);        \
+      POOL_UNLOCK();                      \
+      return ret;                         \
+   }
+
+/**
+ * Description:
+ *   Returns every block to the pool. Handles held anywhere become invalid.
+ *   Does not reset the high-water mark.
+ */
+#define POOL_FLUSH(pool)                  __pool_flush(&pool)
+
+/**
+ * Description:
+ *   Takes a block from `pool`.
+ *
+ * Returns (pool_handle_t):
+ *   handle    - Success
+ *   POOL_NONE - Pool exhausted
+ */
+#define POOL_ALLOC(pool)                  pool ## _alloc()
+#define POOL_ALLOC_ISR(pool)              __pool_alloc(&pool)
+
+/**
+ * Description:
+ *   Gives block `h` back to `pool`.
+ *
+ * Returns (int):
+ *   0 - Success
+ *  -1 - Handle was never handed out, or is already free (double free)
+ */
+#define POOL_FREE(pool, h)                pool ## _free(h)
+#define POOL_FREE_ISR(pool, h)            __pool_free(&pool, h)
+
+/**
+ * Description:
+ *   Returns a typed pointer to block `h` of `pool`. Not valid for POOL_NONE.
+ */
+#define POOL_PTR(pool, h)                 pool ## _ptr(h)
+
+/**
+ * Description:
+ *   Number of blocks currently handed out, and the most that have ever been
+ *   handed out at once.
+ */
+#define POOL_USED(pool)                   ((pool).used)
+#define POOL_PEAK(pool)                   ((pool).peak)
+
+#endif /* _UTIL_POOL_H_ */
@@ -0,0 +1,100 @@
+#include <string.h>
+#include <stdint.h>
+
+#include "rtr.h"
+
+typedef struct
+{
+   CAN_TX_HEADER header;
+   uint8_t * data;         // payload source, owned by the application
+   uint8_t loaded[8];      // what the buffer holds right now
+} rtr_entry_t;
+
+rtr_entry_t rtr_table[RTR_MAX_ENTRIES];
+uint8_t rtr_count = 0;
+
+// Undoes what rtr_add() did to the buffer of `entry`: no RTR, and receiving
+// again unless can_init() made it a TX buffer
+static void rtr_release(uint8_t entry)
+{
+   CAN_BUFFER buffer = RTR_FIRST_BUFFER + entry;
+
+   can_disable_rtr(buffer);
+   if (buffer >= RTR_TX_BUFFERS)
+      can_enable_b_receiver(buffer);
+}
+
+void rtr_init()
+{
+   for ( uint8_t i = 0 ; i < rtr_count ; i++ )
+   {
+      can_disable_filter(RTR_FIRST_FILTER + i);
+      rtr_release(i);
+   }
+   rtr_count = 0;
+   can_set_mask_id(RTR_FILTER_MASK, 0x1FFFFFFF, CAN_MASK_ID_TYPE_EID,
+                   CAN_FILTER_MASK_TYPE_SID_OR_EID);
+}
+
+static int16_t rtr_load(uint8_t entry)
+{
+   rtr_entry_t *e = &rtr_table[entry];
+   uint8_t payload[8];
+
+   // `loaded` only changes once the buffer has it, a failed load is retried
+   // by the next rtr_refresh()
+   memcpy(payload, e->data, e->header.Length);
+   if (can_load_rtr(RTR_FIRST_BUFFER + entry, &e->header, payload) != CAN_EC_OK)
+      return -1;
+   memcpy(e->loaded, payload, e->header.Length);
+   return 0;
+}
+
+int16_t rtr_add(uint32_t id, int1 ext, uint8_t *data, uint8_t length)
+{
+   rtr_entry_t *e;
+   CAN_BUFFER buffer;
+   CAN_FILTER filter;
+
+   if (rtr_count >= RTR_MAX_ENTRIES || length > 8)
+      return -1;
+
+   e = &rtr_table[rtr_count];
+   buffer = RTR_FIRST_BUFFER + rtr_count;
+   filter = RTR_FIRST_FILTER + rtr_count;
+
+   e->header.Id = id;
+   e->header.Length = length;
+   e->header.ext = ext;
+   e->header.rtr = FALSE;  // the response is a data frame
+   e->header.Priority = 3;
+   e->data = data;
+
+   // The filter goes on last, no request reaches a half set up buffer
+   can_enable_b_transfer(buffer);
+   if (can_enable_rtr(buffer) != CAN_EC_OK || rtr_load(rtr_count))
+   {
+      rtr_release(rtr_count);
+      return -1;
+   }
+
+   can_set_filter_id(filter, id, ext ? CAN_FILTER_TYPE_EID : CAN_FILTER_TYPE_SID);
+   can_enable_filter(filter, (CAN_FILTER_BUFFER)buffer, RTR_FILTER_MASK);
+   return rtr_count++;
+}
+
+int16_t rtr_refresh()
+{
+   int16_t reloaded = 0;
+   rtr_entry_t *e;
+
+   for ( uint8_t i = 0 ; i < rtr_count ; i++ )
+   {
+      e = &rtr_table[i];
+      if (memcmp(e->loaded, e->data, e->header.Length) == 0)
+         continue;
+      if (rtr_load(i) == 0)
+         reloaded++;
+   }
+   return reloaded;
+}
@@ -0,0 +1,82 @@
+#ifndef _RTR_H_
+#define _RTR_H_
+
+#include <stdint.h>
+
+// Automatic remote frame responses. Each registered Id gets its own ECAN TX
+// buffer with RTR enabled and a filter steering remote requests for that Id
+// to it, so the peripheral answers without the CPU. rtr_refresh() keeps the
+// buffers loaded with the application's current payload.
+//
+// The ECAN uses the lowest numbered matching filter, so any catch-all filter
+// feeding the RX FIFO must be numbered above RTR_FIRST_FILTER + entries.
+
+/**
+ * Description:
+ *   First TX/RX buffer (0-7) handed to RTR responses; the ones below stay
+ *   regular TX buffers for can_putd(). Buffers above 7 can't transmit.
+ */
+#ifndef RTR_FIRST_BUFFER
+#define RTR_FIRST_BUFFER      1
+#endif
+
+#define RTR_MAX_ENTRIES       (8 - RTR_FIRST_BUFFER)
+
+/**
+ * Description:
+ *   TX buffers can_init() sets up, the driver's CAN_TX_BUFFERS. A released RTR
+ *   buffer from here on goes back to receiving.
+ */
+#ifndef RTR_TX_BUFFERS
+#ifdef CAN_TX_BUFFERS
+#define RTR_TX_BUFFERS        CAN_TX_BUFFERS
+#else
+#define RTR_TX_BUFFERS        1     // the driver's default
+#endif
+#endif
+
+/**
+ * Description:
+ *   First acceptance filter and the mask used to match remote requests. The
+ *   mask is set to compare every Id bit.
+ */
+#ifndef RTR_FIRST_FILTER
+#define RTR_FIRST_FILTER      1
+#endif
+
+#ifndef RTR_FILTER_MASK
+#define RTR_FILTER_MASK       CAN_FILTER_MASK_2
+#endif
+
+/**
+ * Description:
+ *   Releases every RTR buffer and sets up the exact-match filter mask. Call
+ *   after can_init().
+ */
+void rtr_init();
+
+/**
+ * Description:
+ *   Answers remote requests for `id`, an extended Id when `ext` is TRUE, with
+ *   `length` bytes from `data`. The payload is loaded now and again by
+ *   rtr_refresh() whenever it changes, so the caller keeps `data` up to date.
+ *
+ * Returns (int16_t):
+ *   0..N - entry index
+ *  -1 - No RTR buffer left, or the driver refused the buffer. The buffer is
+ *       left the way it was.
+ */
+int16_t rtr_add(uint32_t id, int1 ext, uint8_t *data, uint8_t length);
+
+/**
+ * Description:
+ *   Reloads every RTR buffer whose payload source changed since it was last
+ *   loaded. Cheap when nothing changed, call it after updating payloads or
+ *   from a periodic task.
+ *
+ * Returns (int16_t):
+ *   0..N - number of buffers reloaded
+ */
+int16_t rtr_refresh();
+
+#endif /* _RTR_H_ */
@@ -0,0 +1,141 @@
+#include <string.h>
+#include <stdint.h>
+
+#include "rxfilter.h"
+
+#define RXF_EXT_FLAG          0x80000000  // keeps 11 and 29 bit Ids apart
+
+typedef struct
+{
+   uint32_t key;              // Id | RXF_EXT_FLAG, 0xFFFFFFFF when empty
+   uint32_t last_ms;          // last time the payload was let through
+   uint8_t length;
+   uint8_t data[8];
+} rxf_slot_t;
+
+typedef struct
+{
+   uint32_t id;
+   uint32_t last_ms;
+   uint16_t min_interval_ms;
+   int1 seen;
+} rxf_limit_t;
+
+rxf_slot_t rxf_cache[RXF_CACHE_SLOTS];
+rxf_limit_t rxf_limits[RXF_MAX_LIMITS];
+uint8_t rxf_limit_count = 0;
+rxf_stats_t rxf_counters;
+
+static uint32_t rxf_key(uint32_t id, int1 ext)
+{
+   return ext ? (id | RXF_EXT_FLAG) : id;
+}
+
+void rxf_init()
+{
+   for ( uint8_t i = 0 ; i < RXF_CACHE_SLOTS ; i++ )
+      rxf_cache[i].key = 0xFFFFFFFF;
+   rxf_limit_count = 0;
+   memset(&rxf_counters, 0, sizeof(rxf_counters));
+}
+
+int16_t rxf_set_limit(uint32_t id, uint16_t min_interval_ms)
+{
+   uint8_t i;
+
+   for ( i = 0 ; i < rxf_limit_count ; i++ )
+      if ( rxf_limits[i].id == id )
+         break;
+
+   if ( min_interval_ms == 0 )
+   {
+      if ( i < rxf_limit_count )
+      {
+         CIRCBUF_LOCK();
+         rxf_limits[i] = rxf_limits[--rxf_limit_count];
+         CIRCBUF_UNLOCK();
+      }
+      return 0;
+   }
+
+   if ( i == RXF_MAX_LIMITS )
+      return -1;  // Table full
+
+   CIRCBUF_LOCK();
+   rxf_limits[i].id = id;
+   rxf_limits[i].min_interval_ms = min_interval_ms;
+   rxf_limits[i].seen = FALSE;
+   if ( i == rxf_limit_count )
+      rxf_limit_count++;
+   CIRCBUF_UNLOCK();
+   return 0;
+}
+
+int1 rxf_pass(can_rx_frame_t *frame, uint32_t now_ms)
+{
+   uint32_t key;
+   uint8_t length;
+   rxf_slot_t *slot;
+   rxf_limit_t *limit = NULL;
+
+   if ( frame->errors != CAN_EC_OK )
+      return TRUE;  // let can_print_rx_msg() report it
+
+   for ( uint8_t i = 0 ; i < rxf_limit_count ; i++ )
+   {
+      if ( rxf_limits[i].id != frame->header.Id )
+         continue;
+      limit = &rxf_limits[i];
+      if ( limit->seen && now_ms - limit->last_ms < limit->min_interval_ms )
+      {
+         rxf_counters.limited++;
+         return FALSE;
+      }
+      break;
+   }
+
+   // a remote frame has no payload to compare, each one is a new request
+   if ( !frame->header.rtr && !RXF_NO_DEDUP(frame->header.Id, frame->header.ext) )
+   {
+      key = rxf_key(frame->header.Id, frame->header.ext);
+      length = frame->header.Length > 8 ? 8 : frame->header.Length;
+      slot = &rxf_cache[frame->header.Id & (RXF_CACHE_SLOTS - 1)];
+
+      if ( slot->key == key && slot->length == length &&
+           memcmp(slot->data, frame->data, length) == 0 )
+      {
+#if RXF_REFRESH_MS > 0
+         if ( now_ms - slot->last_ms < RXF_REFRESH_MS )
+#endif
+         {
+            rxf_counters.repeats++;
+            return FALSE;
+         }
+      }
+      else
+      {
+         if ( slot->key != key && slot->key != 0xFFFFFFFF )
+            rxf_counters.evictions++;
+         slot->key = key;
+         slot->length = length;
+         memcpy(slot->data, frame->data, length);
+      }
+      slot->last_ms = now_ms;
+   }
+
+   // the interval runs from the last frame let through, not the last one seen
+   if ( limit )
+   {
+      limit->seen = TRUE;
+      limit->last_ms = now_ms;
+   }
+   rxf_counters.passed++;
+   return TRUE;
+}
+
+void rxf_stats(rxf_stats_t *stats)
+{
+   CIRCBUF_LOCK();
+   *stats = rxf_counters;
+   CIRCBUF_UNLOCK();
+}
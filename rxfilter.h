@@ -0,0 +1,90 @@
+#ifndef _RXFILTER_H_
+#define _RXFILTER_H_
+
+#include <stdint.h>
+
+// Drops received frames in can_rx_isr() before they take a ring slot. A frame
+// is suppressed when its payload repeats the last one seen for its Id, or when
+// its Id has a rate limit and arrived too soon. Frames read with errors always
+// pass, remote frames and Ids listed in RXF_NO_DEDUP() are never taken for
+// repeats. Enabled with CAN_RX_FILTER.
+
+/**
+ * Description:
+ *   Last payload per Id, direct mapped on the low Id bits. An Id that does not
+ *   hold its slot always passes and takes the slot over. Power of two.
+ */
+#ifndef RXF_CACHE_SLOTS
+#define RXF_CACHE_SLOTS       32
+#endif
+
+/**
+ * Description:
+ *   An unchanged payload is still let through this often, so consumers can
+ *   tell a quiet sender from a missing one. 0 = never.
+ */
+#ifndef RXF_REFRESH_MS
+#define RXF_REFRESH_MS        1000
+#endif
+
+/**
+ * Description:
+ *   TRUE for Ids whose repeated payloads still mean something, protocol
+ *   traffic such as ISO-TP consecutive frames or commands sent twice on
+ *   purpose. Those are only rate limited.
+ */
+#ifndef RXF_NO_DEDUP
+#define RXF_NO_DEDUP(id, ext)   FALSE
+#endif
+
+/**
+ * Description:
+ *   Number of Ids that can have a rate limit.
+ */
+#ifndef RXF_MAX_LIMITS
+#define RXF_MAX_LIMITS        8
+#endif
+
+typedef struct
+{
+   uint32_t passed;
+   uint32_t repeats;          // same payload as the last frame with that Id
+   uint32_t limited;          // inside the rate limit of their Id
+   uint32_t evictions;        // cache slot taken over by another Id
+} rxf_stats_t;
+
+/**
+ * Description:
+ *   Forgets every payload, limit and statistic.
+ */
+void rxf_init();
+
+/**
+ * Description:
+ *   Passes at most one frame every `min_interval_ms` with Id `id`, standard or
+ *   extended, whatever its payload. 0 removes the limit.
+ *
+ * Returns (int16_t):
+ *   0 - Success
+ *  -1 - Table full
+ */
+int16_t rxf_set_limit(uint32_t id, uint16_t min_interval_ms);
+
+/**
+ * Description:
+ *   Decides whether `frame`, received at `now_ms`, goes on to the RX ring.
+ *   Called from the RX ISR.
+ *
+ * Returns (int1):
+ *   TRUE  - Keep the frame
+ *   FALSE - Suppressed, counted in the statistics
+ */
+int1 rxf_pass(can_rx_frame_t *frame, uint32_t now_ms);
+
+/**
+ * Description:
+ *   Copies the statistics with interrupts held off.
+ */
+void rxf_stats(rxf_stats_t *stats);
+
+#endif /* _RXFILTER_H_ */
@@ -0,0 +1,258 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE           // recvmmsg, sendmmsg
+#endif
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include <linux/can/error.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+
+#include "socketcan.h"
+
+#define SC_CMSG_SIZE          (CMSG_SPACE(sizeof(struct scm_timestamping)) + \
+                               CMSG_SPACE(sizeof(uint32_t)))
+
+#ifndef CAN_ERR_CNT
+#define CAN_ERR_CNT           0x00000200U  // data[6..7] hold TEC/REC, Linux 5.19
+#endif
+
+int sc_fd = -1;
+sc_stats_t sc_stats;
+sc_err_t sc_err;
+
+struct can_frame sc_rx[SC_BATCH];
+uint32_t sc_rx_stamps[SC_BATCH];
+char sc_rx_cmsg[SC_BATCH][SC_CMSG_SIZE];
+uint8_t sc_rx_count = 0;
+uint8_t sc_rx_next = 0;
+
+struct can_frame sc_tx[SC_BATCH];
+uint8_t sc_tx_count = 0;
+
+int16_t sc_open(const char *ifname)
+{
+   struct sockaddr_can addr;
+   struct ifreq ifr;
+   can_err_mask_t err_mask = CAN_ERR_CRTL | CAN_ERR_BUSOFF | CAN_ERR_RESTARTED |
+                             CAN_ERR_CNT;
+   int ts = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+   int one = 1;
+
+   memset(&sc_stats, 0, sizeof(sc_stats));
+   memset(&sc_err, 0, sizeof(sc_err));
+   sc_rx_count = sc_rx_next = sc_tx_count = 0;
+
+   if (sc_fd >= 0)
+      close(sc_fd);
+   sc_fd = socket(PF_CAN, SOCK_RAW | SOCK_NONBLOCK, CAN_RAW);
+   if (sc_fd < 0)
+      return -1;
+
+   memset(&ifr, 0, sizeof(ifr));
+   strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+   if (ioctl(sc_fd, SIOCGIFINDEX, &ifr) < 0)
+      goto fail;
+
+   memset(&addr, 0, sizeof(addr));
+   addr.can_family = AF_CAN;
+   addr.can_ifindex = ifr.ifr_ifindex;
+   if (bind(sc_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+      goto fail;
+
+   // Optional extras, the socket works without them
+   setsockopt(sc_fd, SOL_CAN_RAW, CAN_RAW_ERR_FILTER, &err_mask, sizeof(err_mask));
+   setsockopt(sc_fd, SOL_SOCKET, SO_RXQ_OVFL, &one, sizeof(one));
+   if (setsockopt(sc_fd, SOL_SOCKET, SO_TIMESTAMPING, &ts, sizeof(ts)) < 0)
+      setsockopt(sc_fd, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one));
+   return 0;
+
+fail:
+   close(sc_fd);
+   sc_fd = -1;
+   return -1;
+}
+
+// Kernel stamps are CLOCK_REALTIME, lat_now() counts CLOCK_MONOTONIC us
+static int64_t sc_clock_offset_us()
+{
+   struct timespec rt, mono;
+
+   clock_gettime(CLOCK_REALTIME, &rt);
+   clock_gettime(CLOCK_MONOTONIC, &mono);
+   return ((int64_t)rt.tv_sec - mono.tv_sec) * 1000000 +
+          (rt.tv_nsec - mono.tv_nsec) / 1000;
+}
+
+static void sc_err_frame(struct can_frame *f)
+{
+   if (f->can_id & CAN_ERR_BUSOFF)
+      sc_err.bus_off = TRUE;
+   if (f->can_id & CAN_ERR_RESTARTED)
+      sc_err.bus_off = FALSE;
+   // older kernels only fill the counters in controller error frames
+   if (f->can_id & (CAN_ERR_CRTL | CAN_ERR_CNT))
+      sc_err.ec = ((uint16_t)f->data[6] << 8) | f->data[7];
+}
+
+int16_t sc_rx_batch(int timeout_ms)
+{
+   struct mmsghdr msgs[SC_BATCH];
+   struct iovec iov[SC_BATCH];
+   struct pollfd pfd;
+   struct cmsghdr *cmsg;
+   int64_t offset;
+   int n;
+
+   if (sc_rx_next < sc_rx_count)
+      return sc_rx_count - sc_rx_next;  // last batch not consumed yet
+   sc_rx_count = sc_rx_next = 0;
+
+   pfd.fd = sc_fd;
+   pfd.events = POLLIN;
+   n = poll(&pfd, 1, timeout_ms);
+   if (n <= 0)
+      return n < 0 && errno != EINTR ? -1 : 0;
+
+   memset(msgs, 0, sizeof(msgs));
+   for (uint8_t i = 0; i < SC_BATCH; i++) {
+      iov[i].iov_base = &sc_rx[i];
+      iov[i].iov_len = sizeof(struct can_frame);
+      msgs[i].msg_hdr.msg_iov = &iov[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+      msgs[i].msg_hdr.msg_control = sc_rx_cmsg[i];
+      msgs[i].msg_hdr.msg_controllen = SC_CMSG_SIZE;
+   }
+
+   n = recvmmsg(sc_fd, msgs, SC_BATCH, MSG_DONTWAIT, NULL);
+   if (n < 0)
+      return errno == EAGAIN || errno == EINTR ? 0 : -1;
+
+   sc_stats.rx_batches++;
+   offset = sc_clock_offset_us();
+   for (int i = 0; i < n; i++) {
+      struct can_frame *f = &sc_rx[i];
+      int64_t us = -1;
+
+      for (cmsg = CMSG_FIRSTHDR(&msgs[i].msg_hdr); cmsg;
+           cmsg = CMSG_NXTHDR(&msgs[i].msg_hdr, cmsg)) {
+         if (cmsg->cmsg_level != SOL_SOCKET)
+            continue;
+         if (cmsg->cmsg_type == SO_TIMESTAMPING) {
+            struct scm_timestamping *t = (void *)CMSG_DATA(cmsg);
+            us = (int64_t)t->ts[0].tv_sec * 1000000 + t->ts[0].tv_nsec / 1000;
+         } else if (cmsg->cmsg_type == SO_TIMESTAMPNS) {
+            struct timespec *t = (void *)CMSG_DATA(cmsg);
+            us = (int64_t)t->tv_sec * 1000000 + t->tv_nsec / 1000;
+         } else if (cmsg->cmsg_type == SO_RXQ_OVFL) {
+            uint32_t drops;
+            memcpy(&drops, CMSG_DATA(cmsg), sizeof(drops));
+            sc_stats.rx_drops = drops;  // running total from the kernel
+         }
+      }
+
+      if (f->can_id & CAN_ERR_FLAG) {
+         sc_err_frame(f);
+         continue;
+      }
+
+      // Compact in place, error frames leave gaps
+      if (sc_rx_count != i)
+         sc_rx[sc_rx_count] = *f;
+      sc_rx_stamps[sc_rx_count] = us < 0 ? lat_now() : (uint32_t)(us - offset);
+      sc_rx_count++;
+   }
+   sc_stats.rx_frames += sc_rx_count;
+   return sc_rx_count;
+}
+
+int1 sc_kbhit()
+{
+   return sc_rx_next < sc_rx_count;
+}
+
+uint32_t sc_rx_stamp()
+{
+   return sc_rx_next < sc_rx_count ? sc_rx_stamps[sc_rx_next] : lat_now();
+}
+
+can_ec_t sc_getd(CAN_RX_HEADER *header, uint8_t *data)
+{
+   struct can_frame *f;
+
+   if (sc_rx_next >= sc_rx_count)
+      return CAN_EC_BUFFER_RX_EMPTY;
+   f = &sc_rx[sc_rx_next++];
+
+   header->ext = (f->can_id & CAN_EFF_FLAG) != 0;
+   header->rtr = (f->can_id & CAN_RTR_FLAG) != 0;
+   header->Id = f->can_id & (header->ext ? CAN_EFF_MASK : CAN_SFF_MASK);
+   header->Length = f->can_dlc > 8 ? 8 : f->can_dlc;
+   header->Filter = 0;
+   header->Buffer = 0;
+   header->err_ovfl = FALSE;
+   memcpy(data, f->data, header->Length);
+   return CAN_EC_OK;
+}
+
+can_ec_t sc_putd(CAN_TX_HEADER *header, uint8_t *data)
+{
+   struct can_frame *f;
+
+   if (sc_tx_count == SC_BATCH) {
+      sc_flush();
+      if (sc_tx_count == SC_BATCH)
+         return CAN_EC_BUFFER_TX_FULL;  // kernel queue full as well
+   }
+
+   f = &sc_tx[sc_tx_count++];
+   memset(f, 0, sizeof(*f));
+   f->can_id = header->ext ? (header->Id & CAN_EFF_MASK) | CAN_EFF_FLAG
+                           : header->Id & CAN_SFF_MASK;
+   if (header->rtr)
+      f->can_id |= CAN_RTR_FLAG;
+   f->can_dlc = header->Length > 8 ? 8 : header->Length;
+   memcpy(f->data, data, f->can_dlc);
+   return CAN_EC_OK;
+}
+
+int16_t sc_flush()
+{
+   struct mmsghdr msgs[SC_BATCH];
+   struct iovec iov[SC_BATCH];
+   int n;
+
+   if (sc_tx_count == 0)
+      return 0;
+
+   memset(msgs, 0, sizeof(msgs));
+   for (uint8_t i = 0; i < sc_tx_count; i++) {
+      iov[i].iov_base = &sc_tx[i];
+      iov[i].iov_len = sizeof(struct can_frame);
+      msgs[i].msg_hdr.msg_iov = &iov[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+   }
+
+   n = sendmmsg(sc_fd, msgs, sc_tx_count, MSG_DONTWAIT);
+   if (n < 0) {
+      if (errno == EAGAIN || errno == ENOBUFS || errno == EINTR)
+         return sc_tx_count;  // kernel queue full, keep the batch
+      sc_stats.tx_errors += sc_tx_count;
+      sc_tx_count = 0;
+      return -1;
+   }
+
+   sc_stats.tx_batches++;
+   sc_stats.tx_frames += n;
+   sc_tx_count -= n;
+   memmove(sc_tx, &sc_tx[n], sc_tx_count * sizeof(struct can_frame));
+   return sc_tx_count;
+}
@@ -0,0 +1,155 @@
+#ifndef _SOCKETCAN_H_
+#define _SOCKETCAN_H_
+
+#include <stdint.h>
+
+// Linux SocketCAN backend for the canbus layer (see canhw.h). Frames are read
+// and written in batches with recvmmsg() / sendmmsg(), each received frame
+// carries the kernel receive timestamp. There are no interrupts on the host,
+// the application loop calls can_rx_poll() in place of the RX ISR:
+//
+//   can_setup();
+//   for (;;) {
+//      can_rx_poll(10);
+//      while ((h = can_rx_take()) != POOL_NONE) ...
+//      can_tx();
+//   }
+//
+// Local testing without hardware:
+//   ip link add dev vcan0 type vcan && ip link set up vcan0
+// On a real controller let the kernel leave bus-off by itself:
+//   ip link set can0 type can bitrate 500000 restart-ms 100
+//
+// Build with -D_GNU_SOURCE so recvmmsg() / sendmmsg() are declared whatever
+// the system headers were first included by.
+//
+// Remote frames answered by the controller (rtr.h) and the second peripheral
+// (USE_CAN2_PERIPHERAL) are PIC only.
+
+/**
+ * Description:
+ *   Interface can_setup() opens.
+ */
+#ifndef SC_IFNAME
+#define SC_IFNAME             "vcan0"
+#endif
+
+/**
+ * Description:
+ *   Frames moved per recvmmsg() / sendmmsg() call.
+ */
+#ifndef SC_BATCH
+#define SC_BATCH              32
+#endif
+
+// CCS and ECAN driver definitions the canbus layer is written against
+typedef uint8_t int1;
+#ifndef TRUE
+#define TRUE                  1
+#define FALSE                 0
+#endif
+
+typedef enum
+{
+   CAN_EC_OK = 0,
+   CAN_EC_BUFFER_RX_EMPTY,
+   CAN_EC_BUFFER_TX_FULL
+} can_ec_t;
+
+typedef struct
+{
+   uint32_t Id;
+   uint8_t Length;
+   int1 ext;
+   int1 rtr;
+   uint8_t Priority:2;
+} CAN_TX_HEADER;
+
+typedef struct
+{
+   uint32_t Id;
+   uint8_t Length;
+   uint8_t Filter;
+   uint8_t Buffer;
+   int1 err_ovfl;
+   int1 ext;
+   int1 rtr;
+} CAN_RX_HEADER;
+
+#define disable_interrupts(x)    /* single threaded, nothing to hold off */
+#define enable_interrupts(x)
+
+typedef struct
+{
+   uint32_t rx_batches;
+   uint32_t rx_frames;
+   uint32_t rx_drops;         // kernel socket queue overflowed
+   uint32_t tx_batches;
+   uint32_t tx_frames;
+   uint32_t tx_errors;        // frames the kernel refused for good
+} sc_stats_t;
+
+typedef struct
+{
+   uint16_t ec;               // TEC << 8 | REC from the last error frame
+   int1 bus_off;
+} sc_err_t;
+
+extern sc_stats_t sc_stats;
+extern sc_err_t sc_err;
+
+/**
+ * Description:
+ *   Opens and binds a raw CAN socket on interface `ifname`, with error frames
+ *   and receive timestamps turned on.
+ *
+ * Returns (int16_t):
+ *   0 - Success
+ *  -1 - Failed, errno tells why
+ */
+int16_t sc_open(const char *ifname);
+
+/**
+ * Description:
+ *   Waits up to `timeout_ms` for frames and reads up to SC_BATCH of them at
+ *   once. Does nothing while frames from the last batch are still unread.
+ *
+ * Returns (int16_t):
+ *   0..N - frames waiting to be read with sc_getd()
+ *  -1 - Socket error
+ */
+int16_t sc_rx_batch(int timeout_ms);
+
+int1 sc_kbhit();
+
+/**
+ * Description:
+ *   Kernel receive time of the frame sc_getd() returns next, in lat_now()
+ *   ticks.
+ */
+uint32_t sc_rx_stamp();
+
+can_ec_t sc_getd(CAN_RX_HEADER *header, uint8_t *data);
+
+/**
+ * Description:
+ *   Adds a frame to the TX batch, sending the batch first when it is full.
+ *
+ * Returns (can_ec_t):
+ *   CAN_EC_OK - Queued
+ *   CAN_EC_BUFFER_TX_FULL - Batch full and the kernel queue too, try later
+ */
+can_ec_t sc_putd(CAN_TX_HEADER *header, uint8_t *data);
+
+/**
+ * Description:
+ *   Sends the TX batch with one sendmmsg(). Frames the kernel queue has no
+ *   room for stay batched for the next call.
+ *
+ * Returns (int16_t):
+ *   0..N - frames still batched
+ *  -1 - Socket error, the batch was dropped
+ */
+int16_t sc_flush();
+
+#endif /* _SOCKETCAN_H_ */
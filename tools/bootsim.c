@@ -0,0 +1,164 @@
+// Host simulation of the staged CAN start-up (can_setup_early() then
+// can_setup_late() in canbus.c). A bus thread delivers numbered frames at a
+// fixed rate to a stand-in for can_rx_isr(), which holds the same lock the
+// pool takes for "interrupts disabled", while the main thread spends the late
+// init time on other work and only then starts draining rx_ring_buf. Frames
+// are checked for gaps, and the time-to-first-frame is compared with starting
+// the receiver after all of the initialisation.
+//
+//   cc -O2 -pthread -I.. -o bootsim bootsim.c
+//   ./bootsim [-r frames/s] [-i late init ms] [-n frames]
+//
+// Exits 1 when a frame was lost.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define CIRCBUF_THREADED
+
+#include "../socketcan.h"   // host CAN_RX_HEADER, CAN_TX_HEADER, can_ec_t
+#include "../canframe.h"
+#include "../latency.h"
+#include "../latency.c"
+#include "../circbuf.h"
+#include "../circbuf.c"
+
+// Taking the pool from the ISR and from the main loop is serialised the way
+// disable_interrupts(GLOBAL) does it on the PIC
+static pthread_mutex_t irq_lock = PTHREAD_MUTEX_INITIALIZER;
+#define POOL_LOCK()           pthread_mutex_lock(&irq_lock)
+#define POOL_UNLOCK()         pthread_mutex_unlock(&irq_lock)
+
+#include "../pool.h"
+#include "../pool.c"
+
+// Same sizes as canbus.c
+POOL_DEF(can_frame_t, can_frame_pool, 48);
+CIRCBUF_DEF(pool_handle_t, rx_ring_buf, 32);
+
+static uint32_t rate = 2000, init_ms = 10, frames = 1000;
+static volatile int rx_enabled, bus_done;
+static uint32_t rx_on, first_rx, bus_start, no_frame, ring_full;
+static volatile int got_rx;
+
+// can_rx_isr() without the controller, frame `seq` has just arrived
+static void rx_isr(uint32_t seq)
+{
+   pool_handle_t h;
+   can_rx_frame_t *f;
+
+   pthread_mutex_lock(&irq_lock);
+   h = __pool_alloc(&can_frame_pool);
+   if (h == POOL_NONE) {
+      no_frame++;
+      pthread_mutex_unlock(&irq_lock);
+      return;
+   }
+   f = &POOL_PTR(can_frame_pool, h)->rx;
+   f->timestamp = lat_now();
+   f->counter = seq;
+   if (!got_rx) {
+      first_rx = f->timestamp;
+      got_rx = 1;
+   }
+   if (rx_ring_buf_push_refd(&h)) {
+      __pool_free(&can_frame_pool, h);
+      ring_full++;
+   }
+   pthread_mutex_unlock(&irq_lock);
+}
+
+// Frame k goes on the wire at bus_start + k / rate, whether anyone listens or
+// not. Frames sent before the receiver is on are not counted as lost, the
+// serial start-up would miss them too.
+static void *bus(void *arg)
+{
+   uint32_t k;
+
+   (void)arg;
+   for (k = 0; k < frames; k++) {
+      uint32_t due = bus_start + (uint64_t)k * 1000000 / rate;
+      int32_t wait = (int32_t)(due - lat_now());
+
+      if (wait > 0)
+         usleep(wait);
+      if (rx_enabled)
+         rx_isr(k);
+   }
+   bus_done = 1;
+   return NULL;
+}
+
+int main(int argc, char **argv)
+{
+   pthread_t tid;
+   pool_handle_t h;
+   uint32_t start, ready, expect = 0, got = 0, gaps = 0, peak = 0;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "r:i:n:")) != -1) {
+      switch (opt) {
+      case 'r': rate = strtoul(optarg, NULL, 0); break;
+      case 'i': init_ms = strtoul(optarg, NULL, 0); break;
+      case 'n': frames = strtoul(optarg, NULL, 0); break;
+      default:
+         fprintf(stderr, "usage: %s [-r frames/s] [-i late init ms] [-n frames]\n",
+                 argv[0]);
+         return 2;
+      }
+   }
+   if (rate == 0)
+      rate = 1;
+
+   lat_init();
+   start = lat_now();
+   bus_start = start;  // the bus is already busy when we power up
+   pthread_create(&tid, NULL, bus, NULL);
+
+   // can_setup_early()
+   POOL_FLUSH(can_frame_pool);
+   CIRCBUF_FLUSH(rx_ring_buf);
+   rx_on = lat_now();
+   rx_enabled = 1;
+
+   // can_setup_late() and the rest of the application, nobody drains yet
+   usleep(init_ms * 1000);
+   ready = lat_now();
+
+   // main loop
+   for (;;) {
+      uint32_t queued = rx_ring_buf.size - CIRCBUF_FS(rx_ring_buf);
+
+      if (queued > peak)
+         peak = queued;
+      if (rx_ring_buf_pop_refd(&h) == 0) {
+         uint32_t seq = POOL_PTR(can_frame_pool, h)->rx.counter;
+
+         if (got == 0)
+            expect = seq;  // first frame after the receiver came on
+         if (seq != expect)
+            gaps += seq - expect;
+         expect = seq + 1;
+         got++;
+         POOL_FREE(can_frame_pool, h);
+         continue;
+      }
+      if (bus_done && CIRCBUF_FS(rx_ring_buf) == rx_ring_buf.size)
+         break;
+      usleep(100);
+   }
+   pthread_join(tid, NULL);
+
+   printf("bus %u frames/s, late init %u ms, %u frames\n", rate, init_ms, frames);
+   printf("staged: rx_on %u us, ready %u us, first frame %u us\n",
+          rx_on - start, ready - start, got_rx ? first_rx - start : 0);
+   printf("serial: rx_on %u us, first frame >= %u us\n",
+          ready - start, ready - start);
+   printf("received %u, lost %u (ring full %u, pool empty %u), ring peak %u/%d\n",
+          got, gaps, ring_full, no_frame, peak, rx_ring_buf.size);
+   return gaps || ring_full || no_frame ? 1 : 0;
+}
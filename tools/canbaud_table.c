@@ -0,0 +1,52 @@
+// Prints the ECAN bit timing canbaud.h picks for each common CAN clock and
+// bit rate, or why there is none. Same solver as the firmware build.
+//
+//   cc -I.. -o canbaud_table canbaud_table.c
+//   ./canbaud_table [sample point per mille, default 875]
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define CAN_BT_NO_CHECK
+#include "../canbaud.h"
+
+static const uint32_t clocks[] = {
+   4000000, 8000000, 10000000, 16000000, 20000000, 32000000, 40000000,
+   48000000, 60000000, 64000000, 70000000
+};
+
+static const uint32_t rates[] = {
+   10000, 20000, 50000, 83333, 100000, 125000, 250000, 500000, 800000, 1000000
+};
+
+int main(int argc, char **argv)
+{
+   // signed, the solver subtracts from the TQ count
+   int sp = argc > 1 ? atoi(argv[1]) : CAN_DEFAULT_SAMPLE_POINT;
+
+   printf("%9s %8s %3s %4s %5s %4s %4s %6s %6s %6s\n", "clock", "rate", "TQ",
+          "BRP", "PRSEG", "SEG1", "SEG2", "SP%", "CFG1", "CFG2");
+   for (unsigned c = 0; c < sizeof(clocks) / sizeof(clocks[0]); c++) {
+      for (unsigned r = 0; r < sizeof(rates) / sizeof(rates[0]); r++) {
+         uint32_t clk = clocks[c], rate = rates[r];
+         int n;
+
+         for (n = 25; n >= 8; n--)
+            if (__CAN_BT_OK(clk, rate, sp, n))
+               break;
+
+         printf("%9u %8u ", clk, rate);
+         if (n < 8) {
+            printf("  - not achievable\n");
+            continue;
+         }
+         printf("%3d %4lu %5d %4d %4d %6.1f %6.4lX %6.4X\n", n,
+                __CAN_BT_BRP(clk, rate, n), __CAN_BT_PRSEG(n, sp),
+                __CAN_BT_SEG1(n, sp), __CAN_BT_SEG2(n, sp),
+                __CAN_BT_SP(n, sp) / 10.0,
+                __CAN_BT_CFG1(clk, rate, n), __CAN_BT_CFG2(n, sp));
+      }
+   }
+   return 0;
+}
@@ -0,0 +1,109 @@
+// Host build of the canbus layer on a Linux SocketCAN interface: canbus.c
+// with CAN_BACKEND_SOCKETCAN, the board bits it expects from canbus.h
+// standing in from host/canbus.h. Brings the interface up with can_setup(),
+// then for -t seconds prints every frame received, sends a counter frame
+// every -p ms with can_pack() and runs the error monitor, the way a PIC
+// main loop would.
+//
+//   cc -O2 -Ihost -I.. -DCAN_BACKEND_SOCKETCAN -o canhost canhost.c
+//   cc ... -DSC_IFNAME='"can0"'             a real interface, vcan0 by default
+//   cc ... -DCAN_RX_FILTER -DCAN_RX_BCAST_READERS=2 -DCIRCBUF_ENABLE_STATS
+//          -DCAN_LOG_BINARY -DCAN_LOG_U2=stderr  the optional parts
+//   ./canhost [-t seconds] [-p ms between frames]
+//
+// LOW_POWER_IDLE, rtr.c, canbaud.c and CAN2 are PIC only. Exits 1 when the
+// interface could not be opened.
+
+#include "../canbus.c"
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <time.h>
+
+stboard_t STBoard;
+static uint32_t ms;
+
+int can_host_fprintf(FILE *stream, const char *format, ...)
+{
+   char host[256];
+   size_t n = 0;
+   va_list ap;
+   int ret;
+
+   // copy the format without the L length modifiers (32 bit, an int here)
+   // and with CCS l (16 bit) as h
+   for (const char *p = format; *p && n < sizeof(host) - 1; p++) {
+      host[n++] = *p;
+      if (*p != '%')
+         continue;
+      while (p[1] && strchr("-+ #0123456789", p[1]) && n < sizeof(host) - 1)
+         host[n++] = *++p;
+      if (p[1] == 'L') {
+         p++;
+      } else if (p[1] == 'l' && n < sizeof(host) - 1) {
+         p++;
+         host[n++] = 'h';
+      } else if (p[1] == '%' && n < sizeof(host) - 1) {
+         host[n++] = *++p;
+      }
+   }
+   host[n] = '\0';
+
+   va_start(ap, format);
+   ret = vfprintf(stream, host, ap);
+   va_end(ap);
+   return ret;
+}
+
+static uint32_t now_ms(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+int main(int argc, char **argv)
+{
+   uint32_t seconds = 10, period = 1000, start, next_tx;
+   uint8_t payload[4];
+   int opt;
+
+   while ((opt = getopt(argc, argv, "t:p:")) != -1) {
+      switch (opt) {
+      case 't': seconds = strtoul(optarg, NULL, 0); break;
+      case 'p': period = strtoul(optarg, NULL, 0); break;
+      default:
+         fprintf(stderr, "usage: %s [-t seconds] [-p ms between frames]\n", argv[0]);
+         return 2;
+      }
+   }
+
+   STBoard.milliseconds = &ms;
+   start = now_ms();
+   can_setup();
+   if (sc_fd < 0) {
+      perror(SC_IFNAME);
+      return 1;
+   }
+   STBoard.can_address = 0x123;
+   next_tx = 0;
+
+   while (ms < seconds * 1000) {
+      ms = now_ms() - start;
+      can_rx_poll(10);
+      can_print_rx_buffer();
+      can_err_poll();
+      if (period && ms >= next_tx) {
+         memcpy(payload, &STBoard.can_msg_tx, sizeof(payload));
+         can_pack(payload, sizeof(payload));
+         next_tx += period;
+      }
+      can_tx();
+   }
+   can_print_latency();
+#ifdef CIRCBUF_ENABLE_STATS
+   can_print_ring_stats();
+#endif
+   return 0;
+}
@@ -0,0 +1,63 @@
+// Host side decoder for the compressed CAN log (see canlog.h). Reads the raw
+// capture of the CAN_LOG_STREAM UART on stdin and prints one frame per line
+// in the same layout as can_print_rx_msg().
+//
+//   cc -I.. -o canlog_decode canlog_decode.c
+//   ./canlog_decode < capture.bin
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../canlog.h"
+#include "../canlog.c"
+
+int main(void)
+{
+   static uint8_t buf[4096];
+   canlog_t log;
+   uint16_t len = 0;
+   uint32_t ms, id;
+   uint8_t ext, dlc, data[8];
+   int16_t r;
+   size_t got;
+   int synced = 0;
+
+   canlog_init(&log);
+   while ((got = fread(&buf[len], 1, sizeof(buf) - len, stdin)) > 0 || len) {
+      len += got;
+      uint16_t pos = 0;
+      for (;;) {
+         if (!synced) {
+            // Joined mid-stream or lost bytes, wait for the next sync
+            while (pos < len && buf[pos] != CANLOG_SYNC)
+               pos++;
+            if (pos == len)
+               break;
+         }
+         r = canlog_decode(&log, &buf[pos], len - pos, &ms, &id, &ext, &dlc, data);
+         if (r == 0)
+            break;
+         if (r < 0) {
+            fprintf(stderr, "corrupt record at byte %u, resyncing\n", pos);
+            synced = 0;
+            pos++;
+            continue;
+         }
+         pos += r;
+         if (dlc == CANLOG_SYNC) {
+            synced = 1;
+            continue;
+         }
+         printf("[%8u]:CAN: from [%X]%s:", ms, id, ext ? "x" : "");
+         for (uint8_t i = 0; i < dlc; i++)
+            printf(" %X", data[i]);
+         printf("\n");
+      }
+      if (got == 0 && pos == 0)
+         break;  // trailing partial record
+      memmove(buf, &buf[pos], len - pos);
+      len -= pos;
+   }
+   return 0;
+}
@@ -0,0 +1,511 @@
+// Host side capture analyzer. Reads a capture, either the text UART log of
+// can_print_rx_msg() or the compressed binary log (see canlog.h), and prints
+// per-Id rate, period jitter, payload change rate and share of the bus load,
+// plus totals. The file is mmap()ed, split into one chunk per thread and the
+// per-chunk results are merged in capture order.
+//
+//   cc -O2 -pthread -I.. -o cantrace cantrace.c -lm
+//   ./cantrace [-j threads] [-r bitrate] capture
+//
+// Binary chunks start on sync records, the only places the decoder can join
+// the stream. A 0xFF byte inside a record can pass for one, so every chunk
+// start is checked by decoding ahead from it, and a chunk whose predecessor
+// does not end exactly where it starts is thrown away and decoded again
+// serially.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../socketcan.h"   // host CAN_RX_HEADER, CAN_TX_HEADER, can_ec_t
+#include "../canframe.h"
+#include "../canlog.h"
+#include "../canlog.c"
+
+#define MAX_THREADS        64
+#define ID_SLOTS           8192    // power of two
+#define ID_LIMIT           (ID_SLOTS / 4 * 3)   // distinct Ids tracked per capture
+#define ID_EMPTY           0xFFFFFFFF
+#define SYNC_CHECK         32      // records decoded to accept a sync
+
+typedef struct
+{
+   uint32_t key;              // Id | ext << 31, ID_EMPTY when unused
+   uint64_t frames;
+   uint64_t changes;          // payload differs from the previous frame
+   uint64_t bits;             // on the wire, before bit stuffing
+   uint64_t gaps;
+   double gap_sum;            // ms
+   double gap_sq;
+   uint32_t gap_min;
+   uint32_t gap_max;
+   can_rx_frame_t first;
+   can_rx_frame_t last;
+} id_stat_t;
+
+typedef struct
+{
+   // input
+   size_t start;              // first byte this chunk decodes
+   size_t stop;               // decode records starting before this
+   // output
+   size_t end;                // where decoding actually stopped
+   canlog_t log;              // decoder state at `end`
+   int synced;
+   uint64_t frames;
+   uint64_t corrupt;
+   uint64_t bits;
+   uint32_t first_ms;
+   uint32_t last_ms;
+   uint32_t errors;           // highest "(N total)" seen in the text log
+   int discarded;
+   uint32_t used;             // slots taken in ids[]
+   uint64_t untracked;        // frames of Ids beyond ID_LIMIT
+   id_stat_t ids[ID_SLOTS];
+} chunk_t;
+
+static const uint8_t *cap;
+static size_t cap_len;
+static int binary;
+
+// Slot of `key`, a free one when it is new, NULL when it is new and the table
+// already tracks ID_LIMIT Ids. The limit keeps free slots around, so probing
+// always ends.
+static id_stat_t *id_slot(chunk_t *c, uint32_t key)
+{
+   uint32_t h = (key * 2654435761u) & (ID_SLOTS - 1);
+
+   while (c->ids[h].key != ID_EMPTY && c->ids[h].key != key)
+      h = (h + 1) & (ID_SLOTS - 1);
+   if (c->ids[h].key == ID_EMPTY) {
+      if (c->used >= ID_LIMIT)
+         return NULL;
+      c->used++;
+   }
+   return &c->ids[h];
+}
+
+static void ids_init(id_stat_t *ids)
+{
+   for (uint32_t i = 0; i < ID_SLOTS; i++)
+      ids[i].key = ID_EMPTY;
+}
+
+static uint32_t frame_bits(const can_rx_frame_t *f)
+{
+   return (f->header.ext ? 67 : 47) + 8 * f->header.Length;
+}
+
+static int same_payload(const can_rx_frame_t *a, const can_rx_frame_t *b)
+{
+   return a->header.Length == b->header.Length &&
+          memcmp(a->data, b->data, a->header.Length) == 0;
+}
+
+static void add_gap(id_stat_t *s, uint32_t gap)
+{
+   if (s->gaps == 0 || gap < s->gap_min)
+      s->gap_min = gap;
+   if (gap > s->gap_max)
+      s->gap_max = gap;
+   s->gap_sum += gap;
+   s->gap_sq += (double)gap * gap;
+   s->gaps++;
+}
+
+static void account(chunk_t *c, const can_rx_frame_t *f)
+{
+   uint32_t key = f->header.Id | (f->header.ext ? 0x80000000 : 0);
+   id_stat_t *s = id_slot(c, key);
+   uint32_t bits = frame_bits(f);
+
+   if (!s)
+      c->untracked++;
+   else if (s->key == ID_EMPTY) {
+      memset(s, 0, sizeof(*s));
+      s->key = key;
+      s->first = *f;
+   } else {
+      add_gap(s, f->timestamp - s->last.timestamp);
+      if (!same_payload(f, &s->last))
+         s->changes++;
+   }
+   if (s) {
+      s->last = *f;
+      s->frames++;
+      s->bits += bits;
+   }
+
+   if (c->frames == 0)
+      c->first_ms = f->timestamp;
+   c->last_ms = f->timestamp;
+   c->frames++;
+   c->bits += bits;
+}
+
+/* --- Binary log ----------------------------------------------------------- */
+
+// Does a believable stream start at `pos`
+static int sync_ok(size_t pos)
+{
+   canlog_t log;
+   uint32_t ms, id;
+   uint8_t ext, dlc, data[8];
+   int16_t r;
+
+   canlog_init(&log);
+   for (int n = 0; n < SYNC_CHECK && pos < cap_len; n++) {
+      r = canlog_decode(&log, (uint8_t *)&cap[pos], cap_len - pos > 0xFFFF ?
+                        0xFFFF : cap_len - pos, &ms, &id, &ext, &dlc, data);
+      if (r < 0 || (n == 0 && dlc != CANLOG_SYNC))
+         return 0;
+      if (r == 0)
+         return 1;  // ran into the end of the capture
+      pos += r;
+   }
+   return 1;
+}
+
+static size_t find_sync(size_t pos)
+{
+   for (; pos < cap_len; pos++)
+      if (cap[pos] == CANLOG_SYNC && sync_ok(pos))
+         return pos;
+   return cap_len;
+}
+
+static void decode_binary(chunk_t *c, size_t pos, size_t stop)
+{
+   can_rx_frame_t f;
+   uint32_t ms, id;
+   uint8_t ext, dlc;
+   int16_t r;
+
+   memset(&f, 0, sizeof(f));
+   while (pos < stop) {
+      if (!c->synced) {
+         while (pos < cap_len && cap[pos] != CANLOG_SYNC)
+            pos++;
+         if (pos >= stop)
+            break;
+      }
+      r = canlog_decode(&c->log, (uint8_t *)&cap[pos], cap_len - pos > 0xFFFF ?
+                        0xFFFF : cap_len - pos, &ms, &id, &ext, &dlc, f.data);
+      if (r == 0) {
+         pos = cap_len;  // trailing partial record
+         break;
+      }
+      if (r < 0) {
+         c->corrupt++;
+         c->synced = 0;
+         pos++;
+         continue;
+      }
+      pos += r;
+      if (dlc == CANLOG_SYNC) {
+         c->synced = 1;
+         continue;
+      }
+      f.header.Id = id;
+      f.header.ext = ext;
+      f.header.Length = dlc;
+      f.timestamp = ms;
+      f.errors = CAN_EC_OK;
+      account(c, &f);
+   }
+   c->end = pos;
+}
+
+/* --- Text log ------------------------------------------------------------- */
+
+static size_t next_line(size_t pos)
+{
+   const uint8_t *nl;
+
+   if (pos >= cap_len)
+      return cap_len;
+   nl = memchr(&cap[pos], '\n', cap_len - pos);
+   return nl ? (size_t)(nl - cap) + 1 : cap_len;
+}
+
+// [      12]:CAN: Received msg num[3] from [1A5]: 1 FF 0
+// [      12]:CAN: from [1A5]x: 1 FF 0                       (canlog_decode)
+// [      12]:CAN:Received message level ERROR [1] (7 total):
+static void parse_line(chunk_t *c, const char *line)
+{
+   can_rx_frame_t f;
+   const char *p;
+   char *e;
+   unsigned long v;
+
+   if (line[0] != '[')
+      return;
+   memset(&f, 0, sizeof(f));
+   f.timestamp = strtoul(line + 1, &e, 10);
+   if (strncmp(e, "]:CAN:", 6))
+      return;
+   p = e + 6;
+
+   if ((e = strstr(p, "ERROR [")) != NULL && (e = strchr(e, '(')) != NULL) {
+      v = strtoul(e + 1, NULL, 10);
+      if (v > c->errors)
+         c->errors = v;
+      return;
+   }
+
+   if ((p = strstr(p, "from [")) == NULL)
+      return;
+   f.header.Id = strtoul(p + 6, &e, 16);
+   if (*e++ != ']')
+      return;
+   if (*e == 'x') {
+      f.header.ext = TRUE;
+      e++;
+   }
+   if (*e++ != ':')
+      return;
+   while (f.header.Length < 8) {
+      char *n;
+      v = strtoul(e, &n, 16);
+      if (n == e)
+         break;
+      f.data[f.header.Length++] = v;
+      e = n;
+   }
+   f.errors = CAN_EC_OK;
+   account(c, &f);
+}
+
+static void decode_text(chunk_t *c, size_t pos, size_t stop)
+{
+   char line[256];
+
+   while (pos < stop) {
+      size_t next = next_line(pos);
+      size_t n = next - pos < sizeof(line) ? next - pos : sizeof(line) - 1;
+
+      memcpy(line, &cap[pos], n);
+      line[n] = 0;
+      parse_line(c, line);
+      pos = next;
+   }
+   c->end = pos;
+}
+
+/* --- Chunks --------------------------------------------------------------- */
+
+static void *worker(void *arg)
+{
+   chunk_t *c = arg;
+
+   ids_init(c->ids);
+   canlog_init(&c->log);
+   if (binary)
+      decode_binary(c, c->start, c->stop);
+   else
+      decode_text(c, c->start, c->stop);
+   return NULL;
+}
+
+// Appends chunk `c` to the totals in `t`, both in capture order
+static void merge(chunk_t *t, chunk_t *c)
+{
+   for (uint32_t i = 0; i < ID_SLOTS; i++) {
+      id_stat_t *from = &c->ids[i];
+      id_stat_t *to;
+
+      if (from->key == ID_EMPTY)
+         continue;
+      to = id_slot(t, from->key);
+      if (!to) {
+         t->untracked += from->frames;
+         continue;
+      }
+      if (to->key == ID_EMPTY) {
+         *to = *from;
+         continue;
+      }
+      // the frames either side of the chunk boundary
+      add_gap(to, from->first.timestamp - to->last.timestamp);
+      if (!same_payload(&from->first, &to->last))
+         to->changes++;
+      if (from->gaps) {
+         if (from->gap_min < to->gap_min)
+            to->gap_min = from->gap_min;
+         if (from->gap_max > to->gap_max)
+            to->gap_max = from->gap_max;
+      }
+      to->gaps += from->gaps;
+      to->gap_sum += from->gap_sum;
+      to->gap_sq += from->gap_sq;
+      to->frames += from->frames;
+      to->changes += from->changes;
+      to->bits += from->bits;
+      to->last = from->last;
+   }
+   if (c->frames) {
+      if (t->frames == 0)
+         t->first_ms = c->first_ms;
+      t->last_ms = c->last_ms;
+   }
+   t->frames += c->frames;
+   t->bits += c->bits;
+   t->corrupt += c->corrupt;
+   t->untracked += c->untracked;
+   if (c->errors > t->errors)
+      t->errors = c->errors;
+}
+
+static int by_key(const void *a, const void *b)
+{
+   const id_stat_t *x = a, *y = b;
+
+   if (x->key == y->key)
+      return 0;
+   return x->key < y->key ? -1 : 1;
+}
+
+static void report(chunk_t *t, uint32_t bitrate)
+{
+   double secs = (t->last_ms - t->first_ms) / 1000.0;
+   uint32_t n = 0;
+
+   for (uint32_t i = 0; i < ID_SLOTS; i++)
+      if (t->ids[i].key != ID_EMPTY)
+         t->ids[n++] = t->ids[i];
+   qsort(t->ids, n, sizeof(id_stat_t), by_key);
+
+   printf("%-10s %10s %9s %10s %10s %8s %8s %8s %7s\n", "Id", "frames", "rate/s",
+          "period ms", "jitter ms", "min ms", "max ms", "change%", "load%");
+   for (uint32_t i = 0; i < n; i++) {
+      id_stat_t *s = &t->ids[i];
+      double mean = s->gaps ? s->gap_sum / s->gaps : 0;
+      double var = s->gaps ? s->gap_sq / s->gaps - mean * mean : 0;
+      char id[16];
+
+      snprintf(id, sizeof(id), "%X%s", s->key & 0x1FFFFFFF,
+               s->key & 0x80000000 ? "x" : "");
+      printf("%-10s %10llu %9.1f %10.2f %10.2f %8u %8u %8.1f %7.2f\n", id,
+             (unsigned long long)s->frames, secs > 0 ? s->frames / secs : 0,
+             mean, var > 0 ? sqrt(var) : 0, s->gap_min, s->gap_max,
+             s->frames > 1 ? 100.0 * s->changes / (s->frames - 1) : 0,
+             secs > 0 ? 100.0 * s->bits / (secs * bitrate) : 0);
+   }
+   printf("\n%llu frames, %u Ids, %.3f s, bus load %.2f%% of %u bit/s"
+          " (before stuffing)\n", (unsigned long long)t->frames, n, secs,
+          secs > 0 ? 100.0 * t->bits / (secs * bitrate) : 0, bitrate);
+   printf("error frames %u, corrupt records %llu\n", t->errors,
+          (unsigned long long)t->corrupt);
+   if (t->untracked)
+      printf("more than %u Ids, %llu frames of the others only in the totals\n",
+             ID_LIMIT, (unsigned long long)t->untracked);
+}
+
+int main(int argc, char **argv)
+{
+   static chunk_t total;
+   chunk_t *chunks;
+   pthread_t tid[MAX_THREADS];
+   int started[MAX_THREADS];
+   long threads = sysconf(_SC_NPROCESSORS_ONLN);
+   uint32_t bitrate = 500000;
+   struct stat st;
+   int opt, fd;
+
+   while ((opt = getopt(argc, argv, "j:r:")) != -1) {
+      if (opt == 'j')
+         threads = atol(optarg);
+      else if (opt == 'r')
+         bitrate = strtoul(optarg, NULL, 0);
+      else
+         break;
+   }
+   if (optind != argc - 1 || bitrate == 0) {
+      fprintf(stderr, "usage: %s [-j threads] [-r bitrate] capture\n", argv[0]);
+      return 2;
+   }
+   if (threads < 1)
+      threads = 1;
+   if (threads > MAX_THREADS)
+      threads = MAX_THREADS;
+
+   fd = open(argv[optind], O_RDONLY);
+   if (fd < 0 || fstat(fd, &st) < 0) {
+      perror(argv[optind]);
+      return 1;
+   }
+   cap_len = st.st_size;
+   if (cap_len == 0)
+      return 0;
+   cap = mmap(NULL, cap_len, PROT_READ, MAP_PRIVATE, fd, 0);
+   if (cap == MAP_FAILED) {
+      perror("mmap");
+      return 1;
+   }
+   madvise((void *)cap, cap_len, MADV_SEQUENTIAL);
+   binary = cap[0] == CANLOG_SYNC;
+
+   if ((size_t)threads > cap_len / 4096 + 1)
+      threads = cap_len / 4096 + 1;  // not worth a thread per few records
+   chunks = calloc(threads, sizeof(chunk_t));
+   if (!chunks) {
+      perror("calloc");
+      return 1;
+   }
+
+   // Chunk starts: text on a line, binary on a checked sync record
+   for (long i = 0; i < threads; i++) {
+      size_t at = cap_len / threads * i;
+
+      if (i == 0)
+         chunks[i].start = 0;
+      else if (binary)
+         chunks[i].start = find_sync(at);
+      else
+         chunks[i].start = at ? next_line(at - 1) : 0;
+   }
+   for (long i = 0; i < threads; i++)
+      chunks[i].stop = i + 1 < threads ? chunks[i + 1].start : cap_len;
+
+   for (long i = 0; i < threads; i++) {
+      int err = pthread_create(&tid[i], NULL, worker, &chunks[i]);
+
+      started[i] = err == 0;
+      if (err) {
+         fprintf(stderr, "pthread_create: %s, decoding serially\n", strerror(err));
+         worker(&chunks[i]);
+      }
+   }
+   for (long i = 0; i < threads; i++)
+      if (started[i])
+         pthread_join(tid[i], NULL);
+
+   // A chunk whose predecessor overran its start began on a false sync or
+   // after corruption: drop it and carry on from where the predecessor is
+   for (long i = 0; i < threads; ) {
+      long j = i + 1;
+
+      while (j < threads && chunks[i].end != chunks[j].start) {
+         chunks[j].discarded = 1;
+         if (chunks[i].end < cap_len)
+            decode_binary(&chunks[i], chunks[i].end,
+                          j + 1 < threads ? chunks[j + 1].start : cap_len);
+         j++;
+      }
+      i = j;
+   }
+
+   ids_init(total.ids);
+   for (long i = 0; i < threads; i++)
+      if (!chunks[i].discarded)
+         merge(&total, &chunks[i]);
+   report(&total, bitrate);
+   return 0;
+}
@@ -0,0 +1,196 @@
+// Host check and benchmark of circbuf_t across sizes, in whichever counter
+// mode it is built for. For each power of two size it runs
+//
+//   burst   fill to full, check a push is refused, drain, check a pop is
+//           refused, over and over
+//   steady  half full, one push and one pop at a time
+//
+// and checks every element comes out in order, then that CIRCBUF_SPANS and
+// CIRCBUF_FOREACH walk a 7 slot ring the way pops would. Built with
+// CIRCBUF_WIDE it also starts the counters just below the top of size_t and
+// runs them across the wrap. The default mode stops at 16383, the largest size it takes.
+//
+//   cc -O2 -I.. -o circbench circbench.c
+//   cc -O2 -I.. -DCIRCBUF_WIDE -o circbench_wide circbench.c
+//   ./circbench [-n ops per size] [-m max size]
+//
+// Exits 1 when a check failed.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../circbuf.h"
+#include "../circbuf.c"
+
+#ifdef CIRCBUF_WIDE
+#define MAX_SIZE           (1L << 24)
+#else
+#define MAX_SIZE           16383L
+#endif
+
+static double now(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// A circbuf_t over heap storage, CIRCBUF_DEF needs the size at compile time
+static int ring_init(circbuf_t *cb, long size, circbuf_count_t start)
+{
+   memset(cb, 0, sizeof(*cb));
+   cb->buffer = calloc(size, sizeof(uint32_t));
+   cb->size = size;
+   cb->element_size = sizeof(uint32_t);
+   cb->push_count = cb->pop_count = start;
+#ifdef CIRCBUF_THREADED
+   cb->push_cache = cb->pop_cache = start;
+#endif
+   return cb->buffer ? 0 : -1;
+}
+
+static const char *bench(long size, long total)
+{
+   circbuf_t cb;
+   uint32_t in = 0, out = 0, x;
+   long ops = 0;
+   double t0, t1, t2;
+   const char *bad = NULL;
+
+   if (ring_init(&cb, size, 0))
+      return "no memory";
+
+   t0 = now();
+   while (ops < total && !bad) {
+      for (long i = 0; i < size; i++)
+         if (__circbuf_push(&cb, &in) == 0)
+            in++;
+         else
+            bad = "push refused below size";
+      if (__circbuf_push(&cb, &in) == 0)
+         bad = "push accepted when full";
+      if (__circbuf_free_space(&cb) != 0)
+         bad = "free space when full";
+      for (long i = 0; i < size; i++)
+         if (__circbuf_pop(&cb, &x, 0) || x != out++)
+            bad = "out of order";
+      if (__circbuf_pop(&cb, &x, 0) == 0)
+         bad = "pop accepted when empty";
+      ops += 2 * size;
+   }
+   t1 = now();
+
+   for (long i = 0; i < size / 2; i++)
+      __circbuf_push(&cb, &in), in++;
+   t2 = now();
+   for (long i = 0; i < total / 2 && !bad; i++) {
+      __circbuf_push(&cb, &in);
+      in++;
+      if (__circbuf_pop(&cb, &x, 0) || x != out++)
+         bad = "out of order";
+   }
+
+   printf("%9ld  burst %7.1f Mops/s  steady %7.1f Mops/s  %s\n", size,
+          ops / (t1 - t0) / 1e6, total / (now() - t2) / 1e6, bad ? bad : "ok");
+   free(cb.buffer);
+   return bad;
+}
+
+// CIRCBUF_SPANS / CIRCBUF_FOREACH see exactly what the pops would return, at
+// every occupancy and tail position, including the split at the end of storage
+static const char *spans(long size, circbuf_count_t start)
+{
+   circbuf_t cb;
+   circbuf_span_t sp;
+   uint32_t in = 0, out = 0, x, expect;
+   const char *bad = NULL;
+   int n;
+
+   if (ring_init(&cb, size, start))
+      return "no memory";
+   for (int r = 0; r < 200 && !bad; r++) {
+      for (int i = r % (size + 1); i > 0; i--)
+         if (__circbuf_push(&cb, &in) == 0)
+            in++;
+      n = __circbuf_spans(&cb, &sp);
+      if (n != (int)(in - out) || sp.first_len + sp.second_len != n)
+         bad = "span count";
+      expect = out;
+      CIRCBUF_FOREACH(sp, uint32_t, p)
+         if (*p != expect++)
+            bad = "span order";
+      if (expect != in)
+         bad = "span count";
+      for (int i = (r * 3) % (n + 1); i > 0; i--)
+         if (__circbuf_pop(&cb, &x, 0) || x != out++)
+            bad = "out of order";
+   }
+   printf("spans, %ld slots from %zu: %s\n", size, (size_t)start, bad ? bad : "ok");
+   free(cb.buffer);
+   return bad;
+}
+
+#ifdef CIRCBUF_WIDE
+// Counters crossing the top of size_t, occupancy stays right
+static const char *wrap(void)
+{
+   circbuf_t cb;
+   uint32_t in = 0, out = 0, x;
+   const char *bad = NULL;
+
+   if (ring_init(&cb, 64, (circbuf_count_t)-100))
+      return "no memory";
+   for (int r = 0; r < 10; r++) {
+      for (int i = 0; i < 50; i++)
+         __circbuf_push(&cb, &in), in++;
+      if (__circbuf_free_space(&cb) != 14)
+         bad = "free space across the wrap";
+      for (int i = 0; i < 50; i++)
+         if (__circbuf_pop(&cb, &x, 0) || x != out++)
+            bad = "out of order across the wrap";
+   }
+   printf("counter wrap %s\n", bad ? bad : "ok");
+   free(cb.buffer);
+   return bad;
+}
+#endif
+
+int main(int argc, char **argv)
+{
+   long total = 1L << 26, max = MAX_SIZE;
+   int opt, failed = 0;
+
+   while ((opt = getopt(argc, argv, "n:m:")) != -1) {
+      switch (opt) {
+      case 'n': total = strtol(optarg, NULL, 0); break;
+      case 'm': max = strtol(optarg, NULL, 0); break;
+      default:
+         fprintf(stderr, "usage: %s [-n ops per size] [-m max size]\n", argv[0]);
+         return 2;
+      }
+   }
+   if (max > MAX_SIZE)
+      max = MAX_SIZE;
+
+#ifdef CIRCBUF_WIDE
+   printf("CIRCBUF_WIDE, %zu byte counters\n", sizeof(circbuf_count_t));
+#else
+   printf("default counters, wrap at 2 * size\n");
+#endif
+   for (long size = 32; size <= max; size <<= 1)
+      failed |= bench(size, total) != NULL;
+   failed |= spans(7, 0) != NULL;
+#ifndef CIRCBUF_WIDE
+   if (max == MAX_SIZE)
+      failed |= bench(MAX_SIZE, total) != NULL;  // not a power of two, the limit
+#else
+   failed |= wrap() != NULL;
+   failed |= spans(64, (circbuf_count_t)-100) != NULL;
+#endif
+   return failed;
+}
@@ -0,0 +1,283 @@
+// Host simulation of the CAN1 <-> CAN2 gateway (gateway.c) at full bus load.
+// The real gateway, pool and ring code runs against a simulated dual ECAN
+// setup in 1 us steps:
+//
+//   CAN2 RX      a frame arrives back to back every frame time (100% load)
+//                and the RX ISR queues it on rx2_ring_buf
+//   main loop    every -l us: gw_poll(), then can_tx() loads the CAN1 TX
+//                buffers (3, like the ECAN), printing each frame first when
+//                the 115200 baud log is on
+//   CAN1 TX      one frame per frame time out of the TX buffers
+//
+// Forwarding delay is from the RX stamp to the end of the frame on CAN1.
+// Each run is made with the per-frame log line can_tx() used to print for
+// forwarded frames, and without it (now). The last line is the host CPU time
+// gw_route() takes per frame. Rules are checked with the gw_rules walk, or
+// with idmatch when built with -DGW_IDMATCH. Add -DGW_MAX_RULES=64 or so for
+// bigger tables.
+//
+//   cc -O2 -I.. -o gwsim gwsim.c
+//   cc -O2 -I.. -DGW_IDMATCH -o gwsim_idm gwsim.c
+//   ./gwsim [-n frames] [-b bitrate] [-l main loop us] [-r rules]
+//
+// Exits 1 when frames came out of order, or were lost with the log off.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../socketcan.h"   // host CAN_RX_HEADER, CAN_TX_HEADER, can_ec_t
+#include "../canframe.h"
+#include "../circbuf.h"
+#include "../circbuf.c"
+#include "../pool.h"
+#include "../pool.c"
+
+#define HW_TX_BUFFERS      3
+#define LOG_LINE_CHARS     46    // "[%8Ld]:CAN:Data:" and 8 " %LX", 115200 8N1
+
+struct { uint32_t *milliseconds; } STBoard;
+
+POOL_DEF(can_frame_t, can_frame_pool, 4 * 32 + 4);   // canbus.c with CAN2
+CIRCBUF_DEF(pool_handle_t, tx_ring_buf, 32);
+CIRCBUF_DEF(pool_handle_t, rx2_ring_buf, 32);
+CIRCBUF_DEF(pool_handle_t, tx2_ring_buf, 32);
+
+static uint32_t now_us, now_ms;  // simulated time
+static pool_handle_t hw_tx[HW_TX_BUFFERS];
+static uint8_t hw_tx_count;
+
+// Stand-ins for the canbus.c side of the gateway, without the RS232 output
+
+static void can_frame_to_tx(can_frame_t *frame, uint32_t id)
+{
+   CAN_RX_HEADER rx_header = frame->rx.header;
+
+   frame->tx.header.Id = id;
+   frame->tx.header.Length = rx_header.Length;
+   frame->tx.header.ext = rx_header.ext;
+   frame->tx.header.rtr = rx_header.rtr;
+   frame->tx.header.Priority = 0;
+   frame->tx.counter = CAN_TX_FORWARDED;
+}
+
+int16_t can_forward(pool_handle_t h, uint32_t id)
+{
+   can_frame_to_tx(POOL_PTR(can_frame_pool, h), id);
+   if (tx_ring_buf_push_refd(&h)) {
+      POOL_FREE(can_frame_pool, h);
+      return -1;
+   }
+   return 0;
+}
+
+int16_t can2_forward(pool_handle_t h, uint32_t id)
+{
+   can_frame_to_tx(POOL_PTR(can_frame_pool, h), id);
+   if (tx2_ring_buf_push_refd(&h)) {
+      POOL_FREE(can_frame_pool, h);
+      return -1;
+   }
+   return 0;
+}
+
+pool_handle_t can2_rx_take(void)
+{
+   pool_handle_t h;
+
+   return rx2_ring_buf_pop_refd(&h) ? POOL_NONE : h;
+}
+
+int16_t can2_tx(void)
+{
+   return 0;  // nothing goes CAN1 -> CAN2 here
+}
+
+#include "../gateway.c"
+
+static double now(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int by_value(const void *a, const void *b)
+{
+   uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+   return x < y ? -1 : x > y;
+}
+
+// Rules 0..n-1 match Ids 0x100 + 16 * i, traffic hits the last one so the
+// gw_rules walk does its worst
+static void add_rules(int rules)
+{
+   gw_init();
+   for (int i = 0; i < rules; i++)
+      gw_add_rule(GW_CAN2, 0x100 + 16 * i, 0x7F0, GW_KEEP_ID, 0);
+}
+
+static uint32_t traffic_id(int rules, uint32_t i)
+{
+   return 0x100 + 16 * (rules - 1) + (i & 0xF);
+}
+
+// Simulates `frames` frames. With `old` can_tx() prints every frame before
+// loading it, as it did for forwarded frames too. Returns 1 when a frame was
+// lost or reordered.
+static int run(uint32_t frames, uint32_t frame_us, uint32_t loop_us, int old,
+               int rules)
+{
+   uint32_t *delay = malloc(frames * sizeof(uint32_t));
+   uint32_t received = 0, sent = 0, dropped = 0, reordered = 0, queue_peak = 0;
+   uint32_t next_rx = 0, bus_free = 0, main_next = 0, seq, last = 0;
+   uint32_t line_us = LOG_LINE_CHARS * 10 * 1000000 / 115200;
+   pool_handle_t h, on_bus = POOL_NONE;
+   can_frame_t *f;
+
+   if (!delay) {
+      perror("malloc");
+      return 1;
+   }
+   POOL_FLUSH(can_frame_pool);
+   CIRCBUF_FLUSH(tx_ring_buf);
+   CIRCBUF_FLUSH(rx2_ring_buf);
+   hw_tx_count = 0;
+   add_rules(rules);
+
+   // lost in the ISR (pool or rx2 ring full), or by gw_route() (tx ring full)
+   for (now_us = 0; sent + dropped + gw_stats.tx_full < frames; now_us++) {
+      now_ms = now_us / 1000;
+
+      // CAN2 RX ISR
+      if (received < frames && now_us == next_rx) {
+         h = POOL_ALLOC_ISR(can_frame_pool);
+         if (h == POOL_NONE) {
+            dropped++;
+         } else {
+            f = POOL_PTR(can_frame_pool, h);
+            memset(f, 0, sizeof(*f));
+            f->rx.header.Id = traffic_id(rules, received);
+            f->rx.header.Length = 8;
+            f->rx.timestamp = now_us;
+            memcpy(f->rx.data, &received, sizeof(received));
+            if (rx2_ring_buf_push_refd(&h)) {
+               POOL_FREE_ISR(can_frame_pool, h);
+               dropped++;
+            }
+         }
+         received++;
+         next_rx += frame_us;
+      }
+
+      // CAN1 bus, the frame on it is done at bus_free
+      if (on_bus != POOL_NONE && now_us == bus_free) {
+         f = POOL_PTR(can_frame_pool, on_bus);
+         memcpy(&seq, f->tx.data, sizeof(seq));
+         if (sent && seq <= last)
+            reordered++;
+         last = seq;
+         delay[sent++] = now_us - f->tx.timestamp;
+         POOL_FREE(can_frame_pool, on_bus);
+         on_bus = POOL_NONE;
+      }
+      if (on_bus == POOL_NONE && hw_tx_count) {
+         on_bus = hw_tx[0];
+         memmove(hw_tx, hw_tx + 1, --hw_tx_count * sizeof(hw_tx[0]));
+         bus_free = now_us + frame_us;
+      }
+
+      // Main loop: gw_poll(), then can_tx() while there are TX buffers
+      if (now_us >= main_next) {
+         uint32_t busy = 0;
+
+         gw_poll();
+         if ((uint32_t)(tx_ring_buf.size - CIRCBUF_FS(tx_ring_buf)) > queue_peak)
+            queue_peak = tx_ring_buf.size - CIRCBUF_FS(tx_ring_buf);
+         while (hw_tx_count < HW_TX_BUFFERS && CIRCBUF_POP(tx_ring_buf, &h) == 0) {
+            if (old || POOL_PTR(can_frame_pool, h)->tx.counter != CAN_TX_FORWARDED)
+               busy += line_us;
+            hw_tx[hw_tx_count++] = h;
+         }
+         main_next = now_us + loop_us + busy;
+      }
+   }
+
+   dropped += gw_stats.tx_full;
+   qsort(delay, sent, sizeof(uint32_t), by_value);
+   printf("%-22s forwarded %7u  lost %7u (%5.1f%%)  delay p50 %7.3f  p99 %7.3f"
+          "  max %7.3f ms  tx ring peak %2u%s\n",
+          old ? "log line per frame" : "forwarded not logged", sent, dropped,
+          100.0 * dropped / frames, sent ? delay[sent / 2] / 1e3 : 0,
+          sent ? delay[sent / 100 * 99] / 1e3 : 0, sent ? delay[sent - 1] / 1e3 : 0,
+          queue_peak, reordered ? "  OUT OF ORDER" : "");
+   free(delay);
+   return reordered || (!old && dropped);
+}
+
+// Host CPU time of gw_route() per frame, rx2 ring to tx ring
+static void route_cost(int rules, uint32_t n)
+{
+   pool_handle_t h;
+   double t;
+
+   POOL_FLUSH(can_frame_pool);
+   CIRCBUF_FLUSH(tx_ring_buf);
+   add_rules(rules);
+   t = now();
+   for (uint32_t i = 0; i < n; i++) {
+      h = POOL_ALLOC(can_frame_pool);
+      POOL_PTR(can_frame_pool, h)->rx.header.Id = traffic_id(rules, i);
+      gw_route(GW_CAN2, h);
+      CIRCBUF_POP(tx_ring_buf, &h);
+      POOL_FREE(can_frame_pool, h);
+   }
+   t = now() - t;
+   printf("gw_route() on this host: %.1f ns per frame, %.1f M frames/s\n",
+          t / n * 1e9, n / t / 1e6);
+}
+
+int main(int argc, char **argv)
+{
+   uint32_t frames = 200000, bitrate = 500000, loop_us = 100, frame_us;
+   int rules = GW_MAX_RULES, opt, failed = 0;
+
+   while ((opt = getopt(argc, argv, "n:b:l:r:")) != -1) {
+      switch (opt) {
+      case 'n': frames = strtoul(optarg, NULL, 0); break;
+      case 'b': bitrate = strtoul(optarg, NULL, 0); break;
+      case 'l': loop_us = strtoul(optarg, NULL, 0); break;
+      case 'r': rules = strtol(optarg, NULL, 0); break;
+      default:
+         fprintf(stderr, "usage: %s [-n frames] [-b bitrate] [-l main loop us] [-r rules]\n",
+                 argv[0]);
+         return 2;
+      }
+   }
+   if (frames == 0 || bitrate == 0 || rules <= 0 || rules > GW_MAX_RULES) {
+      fprintf(stderr, "need -n > 0, -b > 0 and -r 1..%d\n", GW_MAX_RULES);
+      return 2;
+   }
+   STBoard.milliseconds = &now_ms;
+   // 8 byte standard frame with interframe space, no stuff bits
+   frame_us = (111 * 1000000 + bitrate - 1) / bitrate;
+
+   printf("%u frames CAN2 -> CAN1 at %u bit/s, one every %u us (100%% load), "
+          "main loop every %u us, %d rules (%s)\n", frames, bitrate, frame_us,
+          loop_us, rules,
+#ifdef GW_IDMATCH
+          "idmatch"
+#else
+          "gw_rules walk"
+#endif
+          );
+   failed |= run(frames, frame_us, loop_us, 1, rules);
+   failed |= run(frames, frame_us, loop_us, 0, rules);
+   route_cost(rules, 10000000);
+   return failed;
+}
@@ -0,0 +1,35 @@
+#ifndef _CANBUS_H_
+#define _CANBUS_H_
+
+// Host stand-in for the application's canbus.h, so canbus.c builds against
+// the SocketCAN backend (tools/canhost.c). Provides what the board code
+// provides on the PIC: STBoard, the RS232_U1 stream and the prototypes.
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE           // before any libc header, socketcan.c needs it
+#endif
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "socketcan.h"
+
+typedef struct
+{
+   uint32_t *milliseconds;    // ms since start, kept up by the main loop
+   uint32_t can_address;      // Id can_pack() sends with
+   uint32_t can_msg_rx;
+   uint32_t can_msg_tx;
+} stboard_t;
+
+extern stboard_t STBoard;
+
+#define RS232_U1              stdout
+
+// CCS reads %Lu / %Ld / %LX as 32 bit, glibc as long long, and %lu / %lX as
+// 16 bit, glibc as long. The stand-in drops the L, every such argument here
+// fits an int, and turns the l into h for the 16 bit ones.
+int can_host_fprintf(FILE *stream, const char *format, ...);
+#define fprintf               can_host_fprintf
+
+#endif /* _CANBUS_H_ */
@@ -0,0 +1,122 @@
+// Host benchmark of deep circbuf_t storage on normal 4 KB pages against huge
+// pages (circbuf_huge.h). For each backing it maps a ring of -s frames,
+// fills and drains it -l times checking the order, and reports the time the
+// allocation took (every page is faulted in there), push+pop throughput and
+// how much of the process ended up on transparent huge pages.
+//
+//   cc -O2 -I.. -o hugebench hugebench.c
+//   ./hugebench [-s elements] [-l laps]
+//
+// Explicit huge pages need vm.nr_hugepages set, otherwise that run falls back
+// and says so. Exits 1 when an element came out wrong.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CIRCBUF_WIDE
+
+#include "../circbuf.h"
+#include "../circbuf.c"
+#include "../circbuf_huge.h"
+#include "../circbuf_huge.c"
+
+typedef struct
+{
+   uint32_t id;
+   uint32_t ms;
+   uint8_t data[8];
+} frame_t;
+
+static double now(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long anon_huge_kb(void)
+{
+   FILE *f = fopen("/proc/self/smaps_rollup", "r");
+   char line[256];
+   long kb = -1;
+
+   if (!f)
+      return -1;
+   while (fgets(line, sizeof(line), f))
+      if (sscanf(line, "AnonHugePages: %ld", &kb) == 1)
+         break;
+   fclose(f);
+   return kb;
+}
+
+static int run(const char *name, int flags, int size, int laps)
+{
+   circbuf_t cb;
+   frame_t in, out;
+   double t0, t1, t2;
+   long bad = 0;
+   int got;
+
+   memset(&cb, 0, sizeof(cb));
+   cb.element_size = sizeof(frame_t);
+   t0 = now();
+   got = __circbuf_huge_alloc(&cb, size, flags, CIRCBUF_HUGE_NODE_SELF);
+   t1 = now();
+   if (got < 0) {
+      perror(name);
+      return 1;
+   }
+
+   memset(&in, 0, sizeof(in));
+   for (int l = 0; l < laps; l++) {
+      for (int i = 0; i < size; i++) {
+         in.id = i;
+         __circbuf_push(&cb, &in);
+      }
+      for (int i = 0; i < size; i++)
+         if (__circbuf_pop(&cb, &out, 0) || out.id != (uint32_t)i)
+            bad++;
+   }
+   t2 = now();
+
+   printf("%-10s alloc %6.2f s  %7.1f Mops/s  AnonHugePages %8ld kB  got%s%s%s%s\n",
+          name, t1 - t0, 2.0 * size * laps / (t2 - t1) / 1e6, anon_huge_kb(),
+          got & CIRCBUF_HUGE_EXPLICIT ? " explicit" : "",
+          got & CIRCBUF_HUGE_THP ? " thp" : "",
+          got & CIRCBUF_HUGE_NODE ? " node" : "",
+          bad ? "  WRONG ORDER" : "");
+   __circbuf_huge_free(&cb);
+   return bad ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+   int size = 1 << 24, laps = 3, opt, failed = 0;
+
+   while ((opt = getopt(argc, argv, "s:l:")) != -1) {
+      switch (opt) {
+      case 's': size = strtol(optarg, NULL, 0); break;
+      case 'l': laps = strtol(optarg, NULL, 0); break;
+      default:
+         fprintf(stderr, "usage: %s [-s elements] [-l laps]\n", argv[0]);
+         return 2;
+      }
+   }
+   if (size <= 0 || laps <= 0) {
+      fprintf(stderr, "need -s > 0 and -l > 0\n");
+      return 2;
+   }
+
+   printf("%d frames of %zu bytes (%zu MB), %d laps\n", size, sizeof(frame_t),
+          (size_t)size * sizeof(frame_t) >> 20, laps);
+   failed |= run("4 KB", 0, size, laps);
+   failed |= run("THP", CIRCBUF_HUGE_THP | CIRCBUF_HUGE_NODE, size, laps);
+   failed |= run("explicit", CIRCBUF_HUGE_EXPLICIT | CIRCBUF_HUGE_THP | CIRCBUF_HUGE_NODE,
+                 size, laps);
+   return failed;
+}
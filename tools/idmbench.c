@@ -0,0 +1,158 @@
+// Host check and benchmark of the Id/mask matcher (idmatch.h). For each rule
+// count it fills a table with random rules of every frame type, checks that
+// idm_match() and idm_match_scalar() pick the same rule for random standard
+// and extended Ids (and for Ids built to hit a given rule), then times both.
+// idm_match() uses whatever the build targets, so build it per instruction
+// set:
+//
+//   cc -O2 -I.. -o idmbench idmbench.c          (SSE2 on x86-64)
+//   cc -O2 -I.. -mavx2 -o idmbench_avx2 idmbench.c
+//   ./idmbench [-n lookups per size] [-s seed]
+//
+// Exits 1 when the two disagreed.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../idmatch.h"
+#include "../idmatch.c"
+
+static idm_table_t table;
+static uint32_t *ids;
+static uint8_t *exts;
+
+static double now(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint32_t rand29(void)
+{
+   return ((uint32_t)rand() << 15 ^ rand()) & 0x1FFFFFFF;
+}
+
+// Rules like a gateway table: exact Ids, ranges and catch-alls of both types
+static void fill(int rules)
+{
+   idm_init(&table);
+   for (int i = 0; i < rules; i++) {
+      uint8_t type = rand() % 3;
+      uint32_t mask;
+
+      switch (rand() % 4) {
+      case 0:  mask = type == IDM_EID ? 0x1FFFFFFF : 0x7FF; break;
+      case 1:  mask = type == IDM_EID ? 0x1FFFFF00 : 0x7F0; break;
+      case 2:  mask = 0x03FFFF00; break;  // J1939 PGN
+      default: mask = rand29(); break;
+      }
+      idm_add(&table, type == IDM_SID ? rand29() & 0x7FF : rand29(), mask, type);
+   }
+}
+
+// Every rule count also gets Ids that hit a rule, random ones mostly miss
+static int check(int rules, long n)
+{
+   long bad = 0;
+
+   for (long i = 0; i < n; i++) {
+      uint32_t id = rand29();
+      uint8_t ext = rand() & 1;
+      int16_t a, b;
+
+      if (rules && (i & 1)) {
+         int r = rand() % rules;
+
+         id = (table.filter[r] | (rand29() & ~table.mask[r])) & 0x1FFFFFFF;
+         ext = table.filter[r] >> 31 || (!(table.mask[r] >> 31) && (rand() & 1));
+      }
+      if (!ext)
+         id &= 0x7FF;
+      a = idm_match(&table, id, ext);
+      b = idm_match_scalar(&table, id, ext);
+      if (a != b && bad++ < 5)
+         printf("  Id %08X%s: idm_match %d, idm_match_scalar %d\n", id,
+                ext ? " ext" : "", a, b);
+   }
+   return bad != 0;
+}
+
+static int bench(int rules, long n)
+{
+   volatile int32_t sink = 0;
+   double t0, t1, t2;
+   int failed;
+
+   fill(rules);
+   failed = check(rules, n);
+   for (long i = 0; i < n; i++) {
+      exts[i] = rand() & 1;
+      ids[i] = exts[i] ? rand29() : rand29() & 0x7FF;
+   }
+
+   t0 = now();
+   for (long i = 0; i < n; i++)
+      sink += idm_match_scalar(&table, ids[i], exts[i]);
+   t1 = now();
+   for (long i = 0; i < n; i++)
+      sink += idm_match(&table, ids[i], exts[i]);
+   t2 = now();
+
+   printf("%5d rules  scalar %7.1f ns  idm_match %7.1f ns  %5.1fx  %s\n", rules,
+          (t1 - t0) / n * 1e9, (t2 - t1) / n * 1e9, (t1 - t0) / (t2 - t1),
+          failed ? "MISMATCH" : "same");
+   return failed;
+}
+
+int main(int argc, char **argv)
+{
+   static const int sizes[] = { 0, 1, 7, 8, 9, 16, 64, 128, IDM_MAX_RULES };
+   long n = 1000000;
+   int opt, failed = 0;
+
+   srand(1);
+   while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+      switch (opt) {
+      case 'n': n = strtol(optarg, NULL, 0); break;
+      case 's': srand(strtoul(optarg, NULL, 0)); break;
+      default:
+         fprintf(stderr, "usage: %s [-n lookups per size] [-s seed]\n", argv[0]);
+         return 2;
+      }
+   }
+   if (n <= 0) {
+      fprintf(stderr, "need -n > 0\n");
+      return 2;
+   }
+   ids = malloc(n * sizeof(*ids));
+   exts = malloc(n);
+   if (!ids || !exts) {
+      perror("malloc");
+      return 1;
+   }
+
+#if defined(__AVX2__)
+   printf("idm_match: AVX2, 8 rules per compare\n");
+#elif defined(__SSE2__)
+   printf("idm_match: SSE2, 4 rules per compare\n");
+#else
+   printf("idm_match: scalar\n");
+#endif
+   for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+      failed |= bench(sizes[i], n);
+
+   // a full table refuses the next rule
+   if (idm_add(&table, 0, 0, IDM_ANY) != -1) {
+      printf("idm_add accepted rule %d\n", IDM_MAX_RULES + 1);
+      failed = 1;
+   }
+   free(ids);
+   free(exts);
+   return failed;
+}
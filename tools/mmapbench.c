@@ -0,0 +1,191 @@
+// Host benchmark of the file backed ring (circbuf_mmap.h) against a buffered
+// fwrite() logger, both writing the same can_rx_frame_t stream to a file in
+// `dir`. Reports sustained frames/s and the write() calls it took. Cases:
+//
+//   ring        the capture fits, nobody drains it (crash-proof capture)
+//   ring+reader a ring of -s slots drained by a second thread while it is
+//               written, the way a live consumer would use it
+//   fwrite      stdio with its default buffer, then with a 1 MB one
+//
+// Neither side calls msync() or fsync(): both end up in the page cache.
+//
+//   cc -O2 -pthread -I.. -o mmapbench mmapbench.c
+//   ./mmapbench [-n frames] [-s ring size] [dir]
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "../socketcan.h"   // host CAN_RX_HEADER, CAN_TX_HEADER, can_ec_t
+#include "../canframe.h"
+#include "../circbuf_mmap.h"
+#include "../circbuf_mmap.c"
+
+static uint32_t frames = 4000000, ring_size = 1 << 16;
+static const char *dir = "/tmp";
+static char path[4096];
+static circbuf_mmap_t ring;
+static volatile int writer_done;
+
+static double now(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void make_frame(can_rx_frame_t *f, uint32_t i)
+{
+   f->header.Id = 0x100 + (i & 0x3F);
+   f->header.Length = 8;
+   memcpy(f->data, &i, sizeof(i));
+   f->timestamp = i;
+   f->counter = i;
+}
+
+static void result(const char *name, uint32_t n, double secs, const char *extra)
+{
+   printf("%-22s %10.0f frames/s  %7.1f MB/s  %s\n", name, n / secs,
+          n * sizeof(can_rx_frame_t) / secs / 1e6, extra);
+}
+
+static int open_ring(uint32_t size)
+{
+   unlink(path);
+   ring.hdr = NULL;
+   ring.data = NULL;
+   ring.size = size;
+   ring.element_size = sizeof(can_rx_frame_t);
+   ring.fd = -1;
+   return __circbuf_mmap_open(&ring, path);
+}
+
+static void *drain(void *arg)
+{
+   can_rx_frame_t f;
+   uint32_t *bad = arg, expect = 0;
+
+   while (expect < frames) {
+      if (__circbuf_mmap_pop(&ring, &f, 0)) {
+         if (writer_done && CIRCBUF_MMAP_COUNT(ring) == 0)
+            break;
+         continue;
+      }
+      if (f.counter != expect)
+         (*bad)++;
+      expect++;
+   }
+   return NULL;
+}
+
+static int bench_ring(int reader)
+{
+   can_rx_frame_t f;
+   pthread_t tid;
+   uint32_t size, bad = 0, full = 0;
+   double t;
+   char extra[64];
+
+   for (size = 1; size < frames && size < 0x80000000u; size <<= 1)
+      ;
+   if (reader)
+      size = ring_size;
+   if (open_ring(size)) {
+      perror(path);
+      return 1;
+   }
+   writer_done = 0;
+   t = now();
+   if (reader && pthread_create(&tid, NULL, drain, &bad)) {
+      perror("pthread_create");
+      return 1;
+   }
+   for (uint32_t i = 0; i < frames; i++) {
+      make_frame(&f, i);
+      while (__circbuf_mmap_push(&ring, &f))
+         full++;  // the reader is behind, a live capture would drop instead
+   }
+   writer_done = 1;
+   if (reader)
+      pthread_join(tid, NULL);
+   t = now() - t;
+
+   snprintf(extra, sizeof(extra), "0 write() calls, %u slots%s", size,
+            reader ? (bad ? ", OUT OF ORDER" : "") : "");
+   result(reader ? "ring+reader" : "ring", frames, t, extra);
+   if (reader && full)
+      printf("%-22s writer found the ring full %u times\n", "", full);
+   __circbuf_mmap_close(&ring);
+   unlink(path);
+   return bad ? 1 : 0;
+}
+
+static int bench_fwrite(size_t buffer)
+{
+   can_rx_frame_t f;
+   FILE *fp;
+   char *buf = NULL;
+   double t;
+   char name[32], extra[64];
+
+   unlink(path);
+   fp = fopen(path, "w");
+   if (!fp) {
+      perror(path);
+      return 1;
+   }
+   if (buffer) {
+      buf = malloc(buffer);
+      setvbuf(fp, buf, _IOFBF, buffer);
+   }
+   t = now();
+   for (uint32_t i = 0; i < frames; i++) {
+      make_frame(&f, i);
+      fwrite(&f, sizeof(f), 1, fp);
+   }
+   fclose(fp);
+   t = now() - t;
+
+   snprintf(name, sizeof(name), "fwrite %zu KB buffer", (buffer ? buffer : BUFSIZ) / 1024);
+   // stdio writes whole buffers
+   snprintf(extra, sizeof(extra), "~%llu write() calls",
+            (unsigned long long)frames * sizeof(f) / (buffer ? buffer : BUFSIZ) + 1);
+   result(name, frames, t, extra);
+   free(buf);
+   unlink(path);
+   return 0;
+}
+
+int main(int argc, char **argv)
+{
+   int opt, failed = 0;
+
+   while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+      switch (opt) {
+      case 'n': frames = strtoul(optarg, NULL, 0); break;
+      case 's': ring_size = strtoul(optarg, NULL, 0); break;
+      default:
+         fprintf(stderr, "usage: %s [-n frames] [-s ring size] [dir]\n", argv[0]);
+         return 2;
+      }
+   }
+   if (optind < argc)
+      dir = argv[optind];
+   if (frames == 0 || ring_size == 0 || (ring_size & (ring_size - 1))) {
+      fprintf(stderr, "need -n > 0 and -s a power of two\n");
+      return 2;
+   }
+   snprintf(path, sizeof(path), "%s/mmapbench.%d", dir, (int)getpid());
+
+   printf("%u frames of %zu bytes in %s\n", frames, sizeof(can_rx_frame_t), dir);
+   failed |= bench_ring(0);
+   failed |= bench_ring(1);
+   failed |= bench_fwrite(0);
+   failed |= bench_fwrite(1024 * 1024);
+   return failed;
+}
@@ -0,0 +1,158 @@
+// Host cross-thread benchmark of circbuf_t, to compare the packed layout with
+// CIRCBUF_THREADED (producer and consumer counters on cache lines of their
+// own, each side caching the other's). Build it both ways:
+//
+//   cc -O2 -pthread -I.. -o pingpong pingpong.c
+//   cc -O2 -pthread -I.. -DCIRCBUF_THREADED -o pingpong_thr pingpong.c
+//   ./pingpong [-n round trips] [-a cpu,cpu]
+//
+// ping-pong  one element out on one ring, back on another, one at a time:
+//            every operation hands a cache line to the other core
+// stream     one producer, one consumer, the ring kept busy
+//
+// Use -a to pin the two threads to different cores, the comparison means
+// nothing when both share one: every hand over then waits for the other
+// thread to be scheduled. The packed build relies on x86 store ordering, the
+// spin loops only add compiler barriers. Exits 1 when an element came back
+// wrong.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "../circbuf.h"
+#include "../circbuf.c"
+
+// Retries `op` until it succeeds. Spins with a compiler barrier so the
+// counters are read again, yields after a while so one CPU still gets there.
+#define SPIN_LIMIT         4096
+
+#define SPIN(op)                                            \
+   do {                                                     \
+      for (unsigned __spins = 0; op; __spins++) {           \
+         __asm__ volatile("" ::: "memory");                 \
+         if (__spins >= SPIN_LIMIT)                         \
+            sched_yield();                                  \
+      }                                                     \
+   } while (0)
+
+CIRCBUF_DEF(uint64_t, ping, 64);
+CIRCBUF_DEF(uint64_t, pong, 64);
+CIRCBUF_DEF(uint64_t, stream, 1024);
+
+static uint64_t trips = 2000000;
+static int cpus[2] = { -1, -1 };
+static volatile uint64_t bad;
+
+static double now(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void pin(int cpu)
+{
+   cpu_set_t set;
+
+   if (cpu < 0)
+      return;
+   CPU_ZERO(&set);
+   CPU_SET(cpu, &set);
+   if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set))
+      fprintf(stderr, "cannot pin to cpu %d\n", cpu);
+}
+
+static void *echo(void *arg)
+{
+   uint64_t v;
+
+   (void)arg;
+   pin(cpus[1]);
+   for (uint64_t i = 0; i < trips; i++) {
+      SPIN(CIRCBUF_POP(ping, &v));
+      SPIN(CIRCBUF_PUSH(pong, &v));
+   }
+   return NULL;
+}
+
+static void *consume(void *arg)
+{
+   uint64_t v, n = *(uint64_t *)arg;
+
+   pin(cpus[1]);
+   for (uint64_t i = 0; i < n; i++) {
+      SPIN(CIRCBUF_POP(stream, &v));
+      if (v != i)
+         bad++;
+   }
+   return NULL;
+}
+
+int main(int argc, char **argv)
+{
+   pthread_t tid;
+   uint64_t v, n;
+   double t;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "n:a:")) != -1) {
+      switch (opt) {
+      case 'n': trips = strtoull(optarg, NULL, 0); break;
+      case 'a':
+         if (sscanf(optarg, "%d,%d", &cpus[0], &cpus[1]) != 2) {
+            fprintf(stderr, "-a wants two cpus, e.g. -a 0,2\n");
+            return 2;
+         }
+         break;
+      default:
+         fprintf(stderr, "usage: %s [-n round trips] [-a cpu,cpu]\n", argv[0]);
+         return 2;
+      }
+   }
+   pin(cpus[0]);
+
+#ifdef CIRCBUF_THREADED
+   printf("CIRCBUF_THREADED, circbuf_t %zu bytes\n", sizeof(circbuf_t));
+#else
+   printf("packed circbuf_t, %zu bytes\n", sizeof(circbuf_t));
+#endif
+
+   if (pthread_create(&tid, NULL, echo, NULL)) {
+      perror("pthread_create");
+      return 1;
+   }
+   t = now();
+   for (uint64_t i = 0; i < trips; i++) {
+      SPIN(CIRCBUF_PUSH(ping, &i));
+      SPIN(CIRCBUF_POP(pong, &v));
+      if (v != i)
+         bad++;
+   }
+   t = now() - t;
+   pthread_join(tid, NULL);
+   printf("ping-pong  %10.0f round trips/s  %7.1f ns each\n", trips / t, t / trips * 1e9);
+
+   n = trips * 16;
+   if (pthread_create(&tid, NULL, consume, &n)) {
+      perror("pthread_create");
+      return 1;
+   }
+   t = now();
+   for (uint64_t i = 0; i < n; i++)
+      SPIN(CIRCBUF_PUSH(stream, &i));
+   pthread_join(tid, NULL);
+   t = now() - t;
+   printf("stream     %10.1f M elements/s\n", n / t / 1e6);
+
+   if (bad)
+      printf("%llu elements came back wrong\n", (unsigned long long)bad);
+   return bad ? 1 : 0;
+}
@@ -0,0 +1,238 @@
+// Host benchmark of the shared memory ring (circbuf_shm.h) against a Unix
+// domain socket between two processes. A forked reader receives frames the
+// size of a CAN frame from the writer, first as fast as they go (throughput),
+// then paced at -r frames/s (one way latency, stamped with CLOCK_MONOTONIC in
+// the writer and compared in the reader). Both sides block when they have to
+// wait: futex waits for the ring, read()/write() for the socket.
+//
+//   cc -O2 -I.. -o shmbench shmbench.c
+//   ./shmbench [-n frames] [-r paced frames/s] [-s ring size]
+//
+// Exits 1 when a frame arrived out of order or not at all.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "../circbuf_shm.h"
+#include "../circbuf_shm.c"
+
+#define RING_NAME          "/shmbench"
+
+typedef struct
+{
+   uint64_t seq;
+   uint64_t sent_ns;          // 0 when not paced
+   uint8_t data[8];
+} frame_t;
+
+typedef struct
+{
+   const char *name;
+   int (*setup)(void);
+   int (*send)(frame_t *f);
+   int (*recv)(frame_t *f);   // in the reader process
+   void (*done)(void);
+} transport_t;
+
+static uint32_t frames = 1000000, rate = 10000, ring_size = 1024;
+static circbuf_shm_t ring;
+static int reader_id;
+static int sock[2];
+
+static uint64_t now_ns(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* --- Transports ---------------------------------------------------------- */
+
+static int shm_setup(void)
+{
+   return circbuf_shm_create(&ring, RING_NAME, ring_size, sizeof(frame_t), 1, 0);
+}
+
+static int shm_send(frame_t *f)
+{
+   return circbuf_shm_push_wait(&ring, f, -1);
+}
+
+static int shm_recv(frame_t *f)
+{
+   if (reader_id < 0) {
+      circbuf_shm_t mine;
+
+      // the writer's mapping is inherited, the reader needs its own cursor
+      reader_id = circbuf_shm_attach(&mine, RING_NAME);
+      if (reader_id < 0)
+         return -1;
+      circbuf_shm_close(&ring, -1);
+      ring = mine;
+   }
+   return circbuf_shm_pop_wait(&ring, reader_id, f, 2000) < 0 ? -1 : 0;
+}
+
+static void shm_done(void)
+{
+   circbuf_shm_close(&ring, -1);
+   circbuf_shm_unlink(RING_NAME);
+}
+
+static int uds_setup(void)
+{
+   // SEQPACKET keeps frame boundaries, like the ring does
+   return socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sock);
+}
+
+static int uds_send(frame_t *f)
+{
+   return write(sock[0], f, sizeof(*f)) == sizeof(*f) ? 0 : -1;
+}
+
+static int uds_recv(frame_t *f)
+{
+   return read(sock[1], f, sizeof(*f)) == sizeof(*f) ? 0 : -1;
+}
+
+static void uds_done(void)
+{
+   close(sock[0]);
+   close(sock[1]);
+}
+
+static const transport_t transports[] = {
+   { "shm ring", shm_setup, shm_send, shm_recv, shm_done },
+   { "unix socket", uds_setup, uds_send, uds_recv, uds_done },
+};
+
+/* --- Runs ---------------------------------------------------------------- */
+
+static int by_value(const void *a, const void *b)
+{
+   uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+   return x < y ? -1 : x > y;
+}
+
+// Reader process: receives `n` frames, prints what it measured
+static int reader(const transport_t *t, uint32_t n, int paced)
+{
+   uint64_t *lat = paced ? malloc(n * sizeof(uint64_t)) : NULL;
+   uint64_t start = 0, bad = 0;
+   frame_t f;
+
+   reader_id = -1;
+   for (uint32_t i = 0; i < n; i++) {
+      if (t->recv(&f)) {
+         fprintf(stderr, "%s: frame %u never arrived\n", t->name, i);
+         return 1;
+      }
+      if (i == 0)
+         start = now_ns();
+      if (f.seq != i || f.data[0] != (uint8_t)i)
+         bad++;
+      if (lat)
+         lat[i] = now_ns() - f.sent_ns;
+   }
+
+   if (!paced) {
+      double secs = (now_ns() - start) / 1e9;
+
+      printf("%-12s throughput %10.0f frames/s", t->name,
+             secs > 0 ? (n - 1) / secs : 0);
+   } else {
+      qsort(lat, n, sizeof(uint64_t), by_value);
+      printf("%-12s latency at %u/s: p50 %6.2f us  p99 %6.2f us  p99.9 %7.2f us"
+             "  max %8.2f us", t->name, rate, lat[n / 2] / 1e3,
+             lat[n / 100 * 99] / 1e3, lat[n / 1000 * 999] / 1e3, lat[n - 1] / 1e3);
+   }
+   printf("%s\n", bad ? "  OUT OF ORDER" : "");
+   fflush(stdout);  // _exit() would drop it
+   free(lat);
+   return bad ? 1 : 0;
+}
+
+static int run(const transport_t *t, uint32_t n, int paced)
+{
+   frame_t f;
+   uint64_t due;
+   pid_t pid;
+   int status;
+
+   if (t->setup()) {
+      perror(t->name);
+      return 1;
+   }
+   fflush(stdout);
+   pid = fork();
+   if (pid < 0) {
+      perror("fork");
+      return 1;
+   }
+   if (pid == 0)
+      _exit(reader(t, n, paced));
+
+   // the ring drops frames pushed before the reader attached
+   if (t->setup == shm_setup)
+      while (!__atomic_load_n(&ring.hdr->reader[0].attached, __ATOMIC_ACQUIRE))
+         usleep(100);
+
+   memset(&f, 0, sizeof(f));
+   due = now_ns();
+   for (uint32_t i = 0; i < n; i++) {
+      if (paced) {
+         due += 1000000000 / rate;
+         while (now_ns() < due)
+            ;  // sleeping would add wakeup jitter to the writer side
+         f.sent_ns = now_ns();
+      }
+      f.seq = i;
+      f.data[0] = i;
+      if (t->send(&f)) {
+         perror(t->name);
+         break;
+      }
+   }
+   waitpid(pid, &status, 0);
+   t->done();
+   return !WIFEXITED(status) || WEXITSTATUS(status);
+}
+
+int main(int argc, char **argv)
+{
+   int opt, failed = 0;
+   uint32_t paced;
+
+   while ((opt = getopt(argc, argv, "n:r:s:")) != -1) {
+      switch (opt) {
+      case 'n': frames = strtoul(optarg, NULL, 0); break;
+      case 'r': rate = strtoul(optarg, NULL, 0); break;
+      case 's': ring_size = strtoul(optarg, NULL, 0); break;
+      default:
+         fprintf(stderr, "usage: %s [-n frames] [-r paced frames/s] [-s ring size]\n",
+                 argv[0]);
+         return 2;
+      }
+   }
+   if (frames < 2 || rate == 0) {
+      fprintf(stderr, "need -n >= 2 and -r > 0\n");
+      return 2;
+   }
+   // a couple of seconds of paced frames is plenty
+   paced = frames < rate * 2 ? frames : rate * 2;
+
+   printf("%u frames of %zu bytes, ring of %u\n", frames, sizeof(frame_t), ring_size);
+   for (size_t i = 0; i < sizeof(transports) / sizeof(transports[0]); i++)
+      failed |= run(&transports[i], frames, 0);
+   for (size_t i = 0; i < sizeof(transports) / sizeof(transports[0]); i++)
+      failed |= run(&transports[i], paced, 1);
+   return failed;
+}
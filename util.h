@@ -74,6 +74,13 @@
 #  define  __attribute__(x)  /*NOTHING*/
 #endif
 
+/* Called by die() just before the reset, e.g. to leave a note in the
+ * flight recorder (see flightrec.h).
+ */
+#ifndef DIE_HOOK
+#  define DIE_HOOK(err)  /*NOTHING*/
+#endif
+
 /* General helper functions
  */
 void die( char *err, ...) __attribute__((format (printf, 1, 2)))
@@ -85,6 +92,7 @@ void die( char *err, ...) __attribute__((format (printf, 1, 2)))
       //   trace2_cmd_error_va(err, params);
       //   reportf(_("fatal: "), err, params);
    // so, we reboot.
+   DIE_HOOK(err);
    reset_cpu();
 }
 